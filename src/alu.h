@@ -0,0 +1,82 @@
+#ifndef ALU_H_
+#define ALU_H_
+
+#include <cstdint>
+
+#include "cpu.h"
+
+// The CPU's arithmetic and logic instructions. Each takes the flags register
+// and returns its new value; the accumulator is updated in place. The
+// interpreter runs these, and aluverify checks them against a reference.
+
+// Z and N from the result; C and V are left alone
+inline uint16_t alu_flags_zn(uint16_t flags, const uint32_t val) {
+    if(val == 0) {
+        flags |= FLAGS_ZERO;
+    } else {
+        flags &= ~FLAGS_ZERO;
+    }
+
+    if(val & 0x8000) {
+        flags |= FLAGS_NEG;
+    } else {
+        flags &= ~FLAGS_NEG;
+    }
+
+    return flags;
+}
+
+inline uint16_t alu_flags_cv(uint16_t flags, const uint32_t val, const uint16_t op1, const uint16_t op2) {
+    if(val > 0xFFFF) {
+        flags |= FLAGS_CARRY;
+    } else {
+        flags &= ~FLAGS_CARRY;
+    }
+
+    //(~(a ^ b))&(a ^ c)&0x80
+    if( (~(op1 ^ op2)) & (op1 ^ val) & 0x8000 ) {
+        flags |= FLAGS_OVERFLOW;
+    } else {
+        flags &= ~FLAGS_OVERFLOW;
+    }
+
+    return flags;
+}
+
+inline uint16_t alu_add(uint16_t &acc, const uint16_t operand, const uint16_t flags) {
+    const uint16_t op1 = acc;
+    const uint32_t val = acc += operand;
+
+    return alu_flags_cv(alu_flags_zn(flags, val), val, op1, operand);
+}
+
+// operand is a reference: for ADC rX, rX the carry is added before it is read
+inline uint16_t alu_adc(uint16_t &acc, const uint16_t &operand, const uint16_t flags) {
+    if(flags & FLAGS_CARRY) ++acc;
+
+    return alu_add(acc, operand, flags);
+}
+
+inline uint16_t alu_cmp(const uint16_t acc, const uint16_t operand, const uint16_t flags) {
+    const uint32_t val = (acc - operand);
+
+    return alu_flags_cv(alu_flags_zn(flags, val), val, acc, operand);
+}
+
+inline uint16_t alu_and(uint16_t &acc, const uint16_t operand, const uint16_t flags) {
+    return alu_flags_zn(flags, acc &= operand);
+}
+
+inline uint16_t alu_or(uint16_t &acc, const uint16_t operand, const uint16_t flags) {
+    return alu_flags_zn(flags, acc |= operand);
+}
+
+inline uint16_t alu_xor(uint16_t &acc, const uint16_t operand, const uint16_t flags) {
+    return alu_flags_zn(flags, acc ^= operand);
+}
+
+inline uint16_t alu_not(uint16_t &acc, const uint16_t flags) {
+    return alu_flags_zn(flags, acc = ~acc);
+}
+
+#endif // ALU_H_
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "alu.h"
+#include "aluengine.h"
+#include "cpu.h"
+
+const AluOpInfo alu_ops[ALU_OPS] = {
+    {"ADD",       0x2012, 0x10000},
+    {"ADC",       0x2112, 0x10000},
+    {"ADC self",  0x2111, 1},
+    {"CMP",       0x4012, 0x10000},
+    {"CMP imm4",  0x4110, 16},
+    {"CMP imm16", 0x4210, 0x10000},
+    {"AND",       0x3112, 0x10000},
+    {"OR",        0x3212, 0x10000},
+    {"XOR",       0x3312, 0x10000},
+    {"NOT",       0x3001, 1},
+};
+
+// Written from the instruction set description rather than from alu.h, quirks
+// included:
+//  - ADD never sets C: the sum is truncated to 16 bits before the carry test
+//  - ADC adds the carry into the accumulator first, and V only looks at the
+//    second addition (so FFFF + carry + 0 does not overflow); ADC rX, rX
+//    reads its operand after that, and adds a + carry to itself
+//  - CMP sets C on borrow, and V when both operands have the same sign but
+//    the difference has the other one (the ADD rule applied to a - b)
+//  - the logic instructions leave C and V alone
+//  - other flags bits are always left alone
+class ReferenceAlu : public AluEngine {
+
+    static uint16_t sign(const uint32_t value) { return (value >> 15) & 1; }
+
+    static uint16_t zn(const uint16_t flags_in, const uint16_t r) {
+        return (flags_in & ~(FLAGS_ZERO | FLAGS_NEG)) | (r == 0 ? FLAGS_ZERO : 0) | (sign(r) ? FLAGS_NEG : 0);
+    }
+
+    static uint16_t add(const uint16_t a, const uint16_t b, const uint16_t flags_in, uint16_t &r) {
+        const int32_t signed_sum = (int16_t)a + (int16_t)b;
+        r = (uint16_t)(a + b);
+        const bool v = signed_sum < INT16_MIN || signed_sum > INT16_MAX;
+        return (zn(flags_in, r) & ~(FLAGS_CARRY | FLAGS_OVERFLOW)) | (v ? FLAGS_OVERFLOW : 0);
+    }
+
+    static uint16_t cmp(const uint16_t a, const uint16_t b, const uint16_t flags_in) {
+        const int32_t difference = (int32_t)a - (int32_t)b;
+        const bool v = sign(a) == sign(b) && sign(difference) != sign(a);
+        return (flags_in & ~FLAGS_COND)
+            | (difference == 0 ? FLAGS_ZERO : 0)
+            | (sign(difference) ? FLAGS_NEG : 0)
+            | (v ? FLAGS_OVERFLOW : 0)
+            | (difference < 0 ? FLAGS_CARRY : 0);
+    }
+
+    template<typename Function>
+    static void each(const uint16_t *b, const size_t count, uint16_t *result, uint16_t *flags, Function function) {
+        for(size_t i = 0; i < count; i++) flags[i] = function(b[i], result[i]);
+    }
+
+public:
+
+    void evaluate(const AluOp op, const uint16_t a, const uint16_t *b, const size_t count,
+                  const uint16_t flags_in, uint16_t *result, uint16_t *flags) override {
+        const uint16_t a_carried = a + ((flags_in & FLAGS_CARRY) ? 1 : 0);
+
+        switch(op) {
+            case ALU_ADD:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { return add(a, b, flags_in, r); });
+                break;
+            case ALU_ADC:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { return add(a_carried, b, flags_in, r); });
+                break;
+            case ALU_ADC_SELF:
+                each(b, count, result, flags, [=](uint16_t, uint16_t &r) { return add(a_carried, a_carried, flags_in, r); });
+                break;
+            case ALU_CMP:
+            case ALU_CMP_IMM4:
+            case ALU_CMP_IMM16:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { r = a; return cmp(a, b, flags_in); });
+                break;
+            case ALU_AND:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { r = a & b; return zn(flags_in, r); });
+                break;
+            case ALU_OR:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { r = a | b; return zn(flags_in, r); });
+                break;
+            case ALU_XOR:
+                each(b, count, result, flags, [=](uint16_t b, uint16_t &r) { r = a ^ b; return zn(flags_in, r); });
+                break;
+            case ALU_NOT:
+                each(b, count, result, flags, [=](uint16_t, uint16_t &r) { r = ~a; return zn(flags_in, r); });
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+// The interpreter's own ALU functions, one loop per instruction so that the
+// compiler vectorizes each of them (this file is built with -O3)
+class CpuAlu : public AluEngine {
+
+    template<typename Function>
+    static void each(const uint16_t a, const uint16_t *b, const size_t count, uint16_t *result, uint16_t *flags, Function function) {
+        for(size_t i = 0; i < count; i++) {
+            uint16_t acc = a;
+            flags[i] = function(acc, b[i]);
+            result[i] = acc;
+        }
+    }
+
+public:
+
+    void evaluate(const AluOp op, const uint16_t a, const uint16_t *b, const size_t count,
+                  const uint16_t flags_in, uint16_t *result, uint16_t *flags) override {
+        switch(op) {
+            case ALU_ADD:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_add(acc, b, flags_in); });
+                break;
+            case ALU_ADC:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_adc(acc, b, flags_in); });
+                break;
+            case ALU_ADC_SELF:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t) { return alu_adc(acc, acc, flags_in); });
+                break;
+            case ALU_CMP:
+            case ALU_CMP_IMM4:
+            case ALU_CMP_IMM16:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_cmp(acc, b, flags_in); });
+                break;
+            case ALU_AND:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_and(acc, b, flags_in); });
+                break;
+            case ALU_OR:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_or(acc, b, flags_in); });
+                break;
+            case ALU_XOR:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t b) { return alu_xor(acc, b, flags_in); });
+                break;
+            case ALU_NOT:
+                each(a, b, count, result, flags, [flags_in](uint16_t &acc, uint16_t) { return alu_not(acc, flags_in); });
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+// Whole instructions, fetched and decoded by the CPU
+class InterpreterAlu : public AluEngine {
+
+    CPU cpu;
+
+public:
+
+    InterpreterAlu() : cpu(0x0200) {
+        cpu.reset();
+    }
+
+    void evaluate(const AluOp op, const uint16_t a, const uint16_t *b, const size_t count,
+                  const uint16_t flags_in, uint16_t *result, uint16_t *flags) override {
+        uint16_t *mem = cpu.memory();
+
+        mem[0x0100] = alu_ops[op].encoding;
+
+        for(size_t i = 0; i < count; i++) {
+            if(op == ALU_CMP_IMM4) mem[0x0100] = alu_ops[op].encoding | b[i];
+            if(op == ALU_CMP_IMM16) mem[0x0101] = b[i];
+
+            cpu.setreg(1, a);
+            cpu.setreg(2, b[i]);
+            cpu.setflags(flags_in);
+            cpu.setPC(0x0100);
+            cpu.run_once();
+
+            result[i] = cpu.getreg(1);
+            flags[i] = cpu.flags();
+        }
+    }
+};
+
+AluEngineFactory alu_engine(const std::string &name) {
+    if(name == "reference") return []() { return std::make_unique<ReferenceAlu>(); };
+    if(name == "cpu") return []() { return std::make_unique<CpuAlu>(); };
+    if(name == "interpreter") return []() { return std::make_unique<InterpreterAlu>(); };
+    return AluEngineFactory();
+}
+
+AluReport verify_alu(const AluEngineFactory &engine, const AluEngineFactory &reference,
+                     const AluOp op, const unsigned threads, const unsigned stride) {
+    const uint32_t operands = alu_ops[op].operands;
+    const uint32_t variants = (op == ALU_ADC || op == ALU_ADC_SELF) ? 2 : 1;     // carry in
+    const uint32_t rows = (0x10000 + stride - 1) / stride * variants;
+
+    std::atomic<uint32_t> next_row(0);
+    std::atomic<uint64_t> checked(0), mismatches(0);
+    std::mutex report_mutex;
+    AluReport report;
+
+    auto worker = [&]() {
+        std::unique_ptr<AluEngine> tested = engine(), expected = reference();
+        std::vector<uint16_t> b(operands), result(operands), flags(operands), ref_result(operands), ref_flags(operands);
+
+        for(uint32_t i = 0; i < operands; i++) b[i] = i;
+
+        for(uint32_t row; (row = next_row++) < rows;) {
+            const uint32_t index = row / variants;
+            const uint16_t a = index * stride;
+            uint16_t flags_in = (index & 1) ? (FLAGS_CARRY | FLAGS_OVERFLOW | FLAGS_BRANCH) : 0;
+            if(variants == 2) flags_in = (flags_in & ~FLAGS_CARRY) | ((row & 1) ? FLAGS_CARRY : 0);
+
+            tested->evaluate(op, a, b.data(), operands, flags_in, result.data(), flags.data());
+            expected->evaluate(op, a, b.data(), operands, flags_in, ref_result.data(), ref_flags.data());
+            checked += operands;
+
+            if(!memcmp(result.data(), ref_result.data(), operands * sizeof(uint16_t))
+               && !memcmp(flags.data(), ref_flags.data(), operands * sizeof(uint16_t))) continue;
+
+            for(uint32_t i = 0; i < operands; i++) {
+                if(result[i] == ref_result[i] && flags[i] == ref_flags[i]) continue;
+
+                mismatches++;
+                std::lock_guard<std::mutex> lock(report_mutex);
+                if(report.first.size() < ALU_MAX_REPORTED)
+                    report.first.push_back({op, a, b[i], flags_in, ref_result[i], ref_flags[i], result[i], flags[i]});
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned i = 1; i < std::max(threads, 1u); i++) pool.emplace_back(worker);
+    worker();
+    for(auto &thread : pool) thread.join();
+
+    report.checked = checked;
+    report.mismatches = mismatches;
+    return report;
+}
@@ -0,0 +1,77 @@
+#ifndef ALUENGINE_H_
+#define ALUENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ALU instructions checked by the verifier, one per encoding
+enum AluOp {
+    ALU_ADD = 0,
+    ALU_ADC,
+    ALU_ADC_SELF,       // ADC r1, r1: the operand is the accumulator
+    ALU_CMP,            // CMP reg, reg
+    ALU_CMP_IMM4,
+    ALU_CMP_IMM16,
+    ALU_AND,
+    ALU_OR,
+    ALU_XOR,
+    ALU_NOT,
+    ALU_OPS
+};
+
+struct AluOpInfo {
+    const char *name;
+    uint16_t encoding;      // with the accumulator in r1 and the operand in r2
+    uint32_t operands;      // operand values: 65536, 16 for imm4, 1 for NOT and ADC self
+};
+
+extern const AluOpInfo alu_ops[ALU_OPS];
+
+// An implementation of the ALU. evaluate() runs op with accumulator a and
+// each of count operands, all with the same flags register on entry, and
+// stores the accumulator and flags afterwards. Engines are used by one
+// thread each.
+class AluEngine {
+public:
+    virtual ~AluEngine() {}
+
+    virtual void evaluate(const AluOp op, const uint16_t a, const uint16_t *b, const size_t count,
+                          const uint16_t flags_in, uint16_t *result, uint16_t *flags) = 0;
+};
+
+typedef std::function<std::unique_ptr<AluEngine>()> AluEngineFactory;
+
+// Built-in engines:
+//   reference    independent model of the documented semantics
+//   cpu          the inline ALU the interpreter runs (alu.h)
+//   interpreter  whole instructions through CPU::run_once(), decoding included
+// Returns an empty factory for an unknown name.
+AluEngineFactory alu_engine(const std::string &name);
+
+struct AluMismatch {
+    AluOp op;
+    uint16_t a, b, flags_in;
+    uint16_t expected_result, expected_flags;
+    uint16_t result, flags;
+};
+
+#define ALU_MAX_REPORTED 16
+
+struct AluReport {
+    uint64_t checked = 0;
+    uint64_t mismatches = 0;
+    std::vector<AluMismatch> first;     // up to ALU_MAX_REPORTED, in no particular order
+};
+
+// Checks op for accumulator values 0, stride, 2 * stride ... against every
+// operand, on threads threads. Flags on entry alternate between all clear
+// and C, V and an unrelated bit set; ADC and ADC self run with both
+// carry-in values.
+AluReport verify_alu(const AluEngineFactory &engine, const AluEngineFactory &reference,
+                     const AluOp op, const unsigned threads, const unsigned stride = 1);
+
+#endif // ALUENGINE_H_
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aluengine.h"
+
+static void usage() {
+    std::cout << "Usage: aluverify [-j threads] [-s stride] [-e engine] [-r reference] [instruction...]" << std::endl
+              << "    -j threads    worker threads (default: all cores)" << std::endl
+              << "    -s stride     only check every stride-th accumulator value (default 1: all)" << std::endl
+              << "    -e engine     engine to check: cpu, interpreter or reference (default cpu)" << std::endl
+              << "    -r reference  engine to check against (default reference)" << std::endl
+              << "    instruction   add, adc, adcself, cmp, cmpimm4, cmpimm16, and, or, xor, not (default all)" << std::endl;
+}
+
+// "CMP imm4" -> "cmpimm4"
+static std::string op_key(const std::string &name) {
+    std::string key;
+    for(char c : name) {
+        if(!isspace((unsigned char)c)) key += tolower((unsigned char)c);
+    }
+    return key;
+}
+
+static void print_mismatch(const AluMismatch &m) {
+    std::cout << std::hex << std::uppercase << std::setfill('0')
+              << "    a=" << std::setw(4) << m.a << " b=" << std::setw(4) << m.b
+              << " flags=" << std::setw(4) << m.flags_in
+              << ": expected " << std::setw(4) << m.expected_result << " flags " << std::setw(4) << m.expected_flags
+              << ", got " << std::setw(4) << m.result << " flags " << std::setw(4) << m.flags
+              << std::dec << std::setfill(' ') << std::endl;
+}
+
+/* Checks an ALU engine against a reference over every operand pair */
+int main(int argc, char **argv)
+{
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned stride = 1;
+    std::string engine_name = "cpu", reference_name = "reference";
+    std::vector<AluOp> ops;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        try {
+            if(arg == "-j" && i + 1 < argc) {
+                threads = std::stoul(argv[++i]);
+            } else if(arg == "-s" && i + 1 < argc) {
+                stride = std::stoul(argv[++i]);
+            } else if(arg == "-e" && i + 1 < argc) {
+                engine_name = argv[++i];
+            } else if(arg == "-r" && i + 1 < argc) {
+                reference_name = argv[++i];
+            } else if(arg[0] == '-') {
+                usage();
+                return 1;
+            } else {
+                unsigned op = 0;
+                while(op < ALU_OPS && op_key(alu_ops[op].name) != op_key(arg)) op++;
+                if(op == ALU_OPS) {
+                    std::cerr << "Unknown instruction: " << arg << std::endl;
+                    return 1;
+                }
+                ops.push_back((AluOp)op);
+            }
+        } catch(std::logic_error const &e) {
+            std::cerr << "Could not parse number: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if(threads == 0 || stride == 0 || stride > 0x10000) {
+        usage();
+        return 1;
+    }
+
+    AluEngineFactory engine = alu_engine(engine_name), reference = alu_engine(reference_name);
+    if(!engine || !reference) {
+        std::cerr << "Unknown engine: " << (engine ? reference_name : engine_name) << std::endl;
+        return 1;
+    }
+
+    if(ops.empty()) {
+        for(unsigned op = 0; op < ALU_OPS; op++) ops.push_back((AluOp)op);
+    }
+
+    std::cout << "Checking " << engine_name << " against " << reference_name
+              << " on " << threads << " thread" << (threads > 1 ? "s" : "") << std::endl;
+
+    uint64_t total_mismatches = 0;
+    for(AluOp op : ops) {
+        const auto start = std::chrono::steady_clock::now();
+        AluReport report = verify_alu(engine, reference, op, threads, stride);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << std::left << std::setw(10) << alu_ops[op].name << std::right
+                  << std::setw(12) << report.checked << " cases  "
+                  << std::fixed << std::setprecision(1) << std::setw(7) << elapsed.count() << " s  "
+                  << std::setw(8) << report.checked / elapsed.count() / 1e6 << " M/s  ";
+        if(report.mismatches) {
+            std::cout << report.mismatches << " MISMATCHES" << std::endl;
+            for(const auto &mismatch : report.first) print_mismatch(mismatch);
+        } else {
+            std::cout << "ok" << std::endl;
+        }
+
+        total_mismatches += report.mismatches;
+    }
+
+    return total_mismatches ? 1 : 0;
+}
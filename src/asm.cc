@@ -0,0 +1,526 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string_view>
+
+#include "asm.h"
+#include "isa.h"
+
+// A value as written: a constant plus at most one symbol not defined yet
+struct AsmValue {
+    int32_t constant = 0;
+    std::string_view symbol;
+    bool hex_dollar = false;    // written as $hex: always takes the 16-bit form
+
+    bool known() const { return symbol.empty(); }
+};
+
+enum AsmOperandKind {
+    OPERAND_REG,                // rN
+    OPERAND_IND,                // (rN)
+    OPERAND_IMM,                // #value
+    OPERAND_TARGET,             // value: jump target
+};
+
+struct AsmOperand {
+    AsmOperandKind kind;
+    unsigned reg;
+    AsmValue value;
+};
+
+// A field of an emitted word waiting for a symbol
+struct AsmFixup {
+    uint32_t address;
+    unsigned shift, bits;
+    bool relative;              // store symbol - (address + 1)
+    std::string symbol;
+    int32_t addend;
+    unsigned line;
+};
+
+#define ASM_MAX_OPERANDS 2
+
+static std::string_view trim(std::string_view text) {
+    while(!text.empty() && isspace((unsigned char)text.front())) text.remove_prefix(1);
+    while(!text.empty() && isspace((unsigned char)text.back())) text.remove_suffix(1);
+    return text;
+}
+
+static bool identifier_start(char c) { return isalpha((unsigned char)c) || c == '_'; }
+static bool identifier_char(char c) { return isalnum((unsigned char)c) || c == '_' || c == '.'; }
+
+// Length of the identifier at the start of text, 0 if there is none
+static size_t identifier_length(std::string_view text) {
+    if(text.empty() || !identifier_start(text[0])) return 0;
+    size_t length = 1;
+    while(length < text.size() && identifier_char(text[length])) length++;
+    return length;
+}
+
+static bool same_letters(std::string_view a, const char *b) {
+    const size_t length = strlen(b);
+    if(a.size() != length) return false;
+    for(size_t i = 0; i < length; i++) {
+        if(toupper((unsigned char)a[i]) != b[i]) return false;
+    }
+    return true;
+}
+
+// r0 .. r15, either case
+static bool parse_register(std::string_view text, unsigned &reg) {
+    if(text.size() < 2 || text.size() > 3 || (text[0] != 'r' && text[0] != 'R')) return false;
+
+    reg = 0;
+    for(size_t i = 1; i < text.size(); i++) {
+        if(!isdigit((unsigned char)text[i])) return false;
+        reg = reg * 10 + (text[i] - '0');
+    }
+    return reg < 16;
+}
+
+// Opcodes by mnemonic, in table order
+struct AsmMnemonic {
+    const char *name;
+    std::vector<uint8_t> opcodes;
+};
+
+static const std::vector<AsmMnemonic> &mnemonics() {
+    static const std::vector<AsmMnemonic> list = []() {
+        std::vector<AsmMnemonic> list;
+        for(unsigned op = 0; op < opcode_table.size(); op++) {
+            if(opcode_table[op].operands == OPERANDS_ILLEGAL) continue;
+
+            auto known = list.begin();
+            while(known != list.end() && strcmp(known->name, opcode_table[op].mnemonic)) known++;
+            if(known == list.end()) known = list.insert(list.end(), {opcode_table[op].mnemonic, {}});
+            known->opcodes.push_back(op);
+        }
+        return list;
+    }();
+    return list;
+}
+
+class Assembly {
+
+    AsmImage &image;
+    uint32_t address;
+    unsigned line = 0;
+    std::vector<bool> written;
+    std::vector<AsmFixup> fixups;
+
+    void error(const std::string &message) { image.errors.push_back({line, message}); }
+
+    bool parse_value(std::string_view text, AsmValue &value);
+    bool parse_operand(std::string_view text, AsmOperand &operand);
+    bool define(std::string_view name, const int32_t value);
+
+    bool emit(const uint16_t word);
+    void field(const uint32_t word_address, const unsigned shift, const unsigned bits,
+               const bool relative, const AsmValue &value);
+
+    void instruction(std::string_view mnemonic, std::string_view operand_text);
+    void directive(std::string_view name, std::string_view arguments);
+
+public:
+
+    Assembly(AsmImage &image) : image(image), address(image.origin), written(0x10000) {}
+
+    void statement(std::string_view text, const unsigned line_number);
+    void resolve();
+};
+
+// Sum and differences of numbers and symbols
+bool Assembly::parse_value(std::string_view text, AsmValue &value) {
+    value = AsmValue();
+    text = trim(text);
+    value.hex_dollar = !text.empty() && text[0] == '$';
+
+    bool negative = false, expect_term = true;
+
+    while(true) {
+        text = trim(text);
+        if(text.empty()) break;
+
+        if(!expect_term) {
+            if(text[0] != '+' && text[0] != '-') {
+                error("unexpected text in value: " + std::string(text));
+                return false;
+            }
+            negative = text[0] == '-';
+            text.remove_prefix(1);
+            expect_term = true;
+            continue;
+        }
+        if(text[0] == '-') {
+            negative = !negative;
+            text.remove_prefix(1);
+            continue;
+        }
+
+        int64_t term = 0;
+        size_t length = 0;
+        unsigned base = 10;
+
+        if(text[0] == '$') {
+            base = 16;
+            text.remove_prefix(1);
+        } else if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+            base = 16;
+            text.remove_prefix(2);
+        }
+
+        if(base == 16 || isdigit((unsigned char)text[0])) {
+            for(; length < text.size() && isxdigit((unsigned char)text[length]); length++) {
+                const char c = toupper((unsigned char)text[length]);
+                const unsigned digit = isdigit((unsigned char)c) ? c - '0' : c - 'A' + 10;
+                if(digit >= base) break;
+                term = term * base + digit;
+                if(term > 0xFFFF) {
+                    error("number out of range: " + std::string(text));
+                    return false;
+                }
+            }
+            if(length == 0 || (length < text.size() && identifier_char(text[length]))) {
+                error("bad number: " + std::string(text));
+                return false;
+            }
+        } else if((length = identifier_length(text))) {
+            const std::string_view name = text.substr(0, length);
+            unsigned reg;
+            const auto symbol = image.symbols.find(std::string(name));
+
+            if(parse_register(name, reg)) {
+                error("register where a value is expected: " + std::string(name));
+                return false;
+            } else if(symbol != image.symbols.end()) {
+                term = symbol->second;
+            } else if(value.symbol.empty() && !negative) {
+                value.symbol = name;
+            } else {
+                error("only label or label + offset can refer to a later symbol: " + std::string(name));
+                return false;
+            }
+        } else {
+            error("bad value: " + std::string(text));
+            return false;
+        }
+
+        value.constant += negative ? -term : term;
+        text.remove_prefix(length);
+        negative = false;
+        expect_term = false;
+    }
+
+    if(expect_term) {
+        error("missing value");
+        return false;
+    }
+    return true;
+}
+
+bool Assembly::parse_operand(std::string_view text, AsmOperand &operand) {
+    text = trim(text);
+
+    if(!text.empty() && text[0] == '(') {
+        if(text.back() != ')' || !parse_register(trim(text.substr(1, text.size() - 2)), operand.reg)) {
+            error("bad indirect register: " + std::string(text));
+            return false;
+        }
+        operand.kind = OPERAND_IND;
+        return true;
+    }
+
+    if(parse_register(text, operand.reg)) {
+        operand.kind = OPERAND_REG;
+        return true;
+    }
+
+    if(!text.empty() && text[0] == '#') {
+        operand.kind = OPERAND_IMM;
+        return parse_value(text.substr(1), operand.value);
+    }
+
+    operand.kind = OPERAND_TARGET;
+    return parse_value(text, operand.value);
+}
+
+bool Assembly::define(std::string_view name, const int32_t value) {
+    unsigned reg;
+
+    if(parse_register(name, reg)) {
+        error("register name used as a symbol: " + std::string(name));
+        return false;
+    }
+    if(!image.symbols.emplace(std::string(name), (uint16_t)value).second) {
+        error("symbol defined twice: " + std::string(name));
+        return false;
+    }
+    return true;
+}
+
+bool Assembly::emit(const uint16_t word) {
+    if(address > 0xFFFF) {
+        error("past the end of memory");
+        return false;
+    }
+    if(written[address]) {
+        error("overlaps earlier code at " + std::to_string(address));
+        return false;
+    }
+
+    const uint32_t index = address - image.origin;
+    if(index >= image.words.size()) image.words.resize(index + 1, 0);
+    image.words[index] = word;
+    written[address++] = true;
+    return true;
+}
+
+// Stores value into bits bits of the word at word_address, from bit shift
+void Assembly::field(const uint32_t word_address, const unsigned shift, const unsigned bits,
+                     const bool relative, const AsmValue &value) {
+    if(word_address > 0xFFFF || !written[word_address]) return;     // emit() failed
+
+    if(!value.known()) {
+        fixups.push_back({word_address, shift, bits, relative, std::string(value.symbol), value.constant, line});
+        return;
+    }
+
+    const int32_t v = relative ? value.constant - (int32_t)(word_address + 1) : value.constant;
+    const int32_t min = (bits == 16) ? -0x8000 : 0;
+    const int32_t max = (1 << bits) - 1;
+
+    if(v < min || v > max) {
+        error("value " + std::to_string(v) + (relative ? " (relative)" : "") + " does not fit in "
+              + std::to_string(bits) + " bits");
+        return;
+    }
+
+    const uint16_t mask = ((1u << bits) - 1) << shift;
+    uint16_t &word = image.words[word_address - image.origin];
+    word = (word & ~mask) | ((v << shift) & mask);
+}
+
+void Assembly::instruction(std::string_view mnemonic, std::string_view operand_text) {
+    AsmOperand operands[ASM_MAX_OPERANDS];
+    unsigned count = 0;
+
+    // JMP.NEQ: the condition is part of the mnemonic. The undefined one is
+    // printed without a dot, as in JMPUNDEFINED.
+    unsigned condition = 0;
+    const size_t dot = mnemonic.find('.');
+    const size_t undefined_length = strlen(condition_suffix[8]);
+    if(dot == std::string_view::npos && mnemonic.size() > undefined_length
+       && same_letters(mnemonic.substr(mnemonic.size() - undefined_length), condition_suffix[8])) {
+        condition = 8;
+        mnemonic.remove_suffix(undefined_length);
+    } else if(dot != std::string_view::npos) {
+        const std::string_view suffix = mnemonic.substr(dot);
+        while(condition < 16 && !same_letters(suffix, condition_suffix[condition])) condition++;
+        if(condition == 16) {
+            error("unknown condition " + std::string(suffix));
+            return;
+        }
+        mnemonic = mnemonic.substr(0, dot);
+    }
+
+    const AsmMnemonic *entry = nullptr;
+    for(const auto &known : mnemonics()) {
+        if(same_letters(mnemonic, known.name)) entry = &known;
+    }
+    if(!entry) {
+        error("unknown instruction " + std::string(mnemonic));
+        return;
+    }
+
+    operand_text = trim(operand_text);
+    while(!operand_text.empty()) {
+        const size_t comma = operand_text.find(',');
+        if(count == ASM_MAX_OPERANDS) {
+            error("too many operands");
+            return;
+        }
+        if(!parse_operand(operand_text.substr(0, comma), operands[count++])) return;
+        if(comma == std::string_view::npos) break;
+        operand_text.remove_prefix(comma + 1);
+        if(trim(operand_text).empty()) {
+            error("missing operand");
+            return;
+        }
+    }
+
+    // The first form in table order that takes these operands. A short
+    // immediate form only takes a value that is known to fit, unless no other
+    // form would do.
+    auto matches = [&](const Operands layout, const bool strict) {
+        auto is = [&](const unsigned i, const AsmOperandKind kind) { return operands[i].kind == kind; };
+        auto imm4 = [&](const unsigned i) {
+            const AsmValue &v = operands[i].value;
+            return is(i, OPERAND_IMM) && (!strict || (v.known() && !v.hex_dollar && v.constant >= 0 && v.constant <= 15));
+        };
+
+        if(dot != std::string_view::npos && layout != OPERANDS_COND_ABS16) return false;
+        switch(layout) {
+            case OPERANDS_NONE:       return count == 0;
+            case OPERANDS_REG_IND:    return count == 2 && is(0, OPERAND_REG) && is(1, OPERAND_IND);
+            case OPERANDS_REG_IMM4:   return count == 2 && is(0, OPERAND_REG) && imm4(1);
+            case OPERANDS_REG_REG:    return count == 2 && is(0, OPERAND_REG) && is(1, OPERAND_REG);
+            case OPERANDS_REG_IMM16:  return count == 2 && is(0, OPERAND_REG) && is(1, OPERAND_IMM);
+            case OPERANDS_IND_REG:    return count == 2 && is(0, OPERAND_IND) && is(1, OPERAND_REG);
+            case OPERANDS_IND_IMM4:   return count == 2 && is(0, OPERAND_IND) && imm4(1);
+            case OPERANDS_REG_LOW:    return count == 1 && is(0, OPERAND_REG);
+            case OPERANDS_REL8:       return count == 1 && (is(0, OPERAND_IMM) || is(0, OPERAND_TARGET));
+            case OPERANDS_IMM8:       return count == 1 && is(0, OPERAND_IMM);
+            case OPERANDS_COND_ABS16: return count == 1 && (is(0, OPERAND_IMM) || is(0, OPERAND_TARGET));
+            default:                  return false;
+        }
+    };
+
+    int opcode = -1;
+    for(const bool strict : {true, false}) {
+        for(const uint8_t op : entry->opcodes) {
+            if(opcode < 0 && matches(opcode_table[op].operands, strict)) opcode = op;
+        }
+    }
+    if(opcode < 0) {
+        error("no form of " + std::string(entry->name) + " takes these operands");
+        return;
+    }
+
+    const uint32_t at = address;
+    const AsmOperand &a = operands[0], &b = operands[1];
+    uint16_t word = opcode << 8;
+
+    switch(opcode_table[opcode].operands) {
+        case OPERANDS_REG_IND:
+        case OPERANDS_REG_REG:
+        case OPERANDS_IND_REG:    word |= (a.reg << 4) | b.reg; break;
+        case OPERANDS_REG_IMM4:
+        case OPERANDS_REG_IMM16:  word |= a.reg << 4; break;
+        case OPERANDS_IND_IMM4:
+        case OPERANDS_REG_LOW:    word |= a.reg; break;
+        case OPERANDS_COND_ABS16: word |= condition; break;
+        default:                  break;
+    }
+    if(!emit(word)) return;
+
+    switch(opcode_table[opcode].operands) {
+        case OPERANDS_REG_IMM4:   field(at, 0, 4, false, b.value); break;
+        case OPERANDS_IND_IMM4:   field(at, 4, 4, false, b.value); break;
+        case OPERANDS_REL8:       field(at, 0, 8, a.kind == OPERAND_TARGET, a.value); break;
+        case OPERANDS_IMM8:       field(at, 0, 8, false, a.value); break;
+        case OPERANDS_REG_IMM16:  if(emit(0)) field(at + 1, 0, 16, false, b.value); break;
+        case OPERANDS_COND_ABS16: if(emit(0)) field(at + 1, 0, 16, false, a.value); break;
+        default:                  break;
+    }
+}
+
+void Assembly::directive(std::string_view name, std::string_view arguments) {
+    AsmValue value;
+
+    if(same_letters(name, ".ORG")) {
+        if(!parse_value(arguments, value)) return;
+        if(!value.known() || value.constant < 0 || value.constant > 0xFFFF) {
+            error(".org needs a known address");
+        } else if(image.words.empty()) {
+            image.origin = address = value.constant;
+        } else if((uint32_t)value.constant < image.origin) {
+            error(".org below the start of the image");
+        } else {
+            address = value.constant;
+        }
+    } else if(same_letters(name, ".WORD")) {
+        while(true) {
+            const size_t comma = arguments.find(',');
+            const uint32_t at = address;
+            if(!parse_value(arguments.substr(0, comma), value)) return;
+            if(emit(0)) field(at, 0, 16, false, value);
+            if(comma == std::string_view::npos) break;
+            arguments.remove_prefix(comma + 1);
+        }
+    } else if(same_letters(name, ".EQU")) {
+        const size_t comma = arguments.find(',');
+        const std::string_view symbol = trim(arguments.substr(0, comma));
+        if(comma == std::string_view::npos || identifier_length(symbol) != symbol.size()) {
+            error(".equ needs a name and a value");
+        } else if(parse_value(arguments.substr(comma + 1), value)) {
+            if(!value.known()) error("constants can only use symbols defined before them");
+            else define(symbol, value.constant);
+        }
+    } else {
+        error("unknown directive " + std::string(name));
+    }
+}
+
+void Assembly::statement(std::string_view text, const unsigned line_number) {
+    line = line_number;
+
+    // Comments
+    const size_t semicolon = text.find(';');
+    const size_t slashes = text.find("//");
+    text = trim(text.substr(0, std::min(semicolon, slashes)));
+
+    // Labels
+    size_t length;
+    while((length = identifier_length(text)) && length < text.size() && text[length] == ':') {
+        define(text.substr(0, length), address);
+        text = trim(text.substr(length + 1));
+    }
+    if(text.empty()) return;
+
+    size_t word_end = 0;
+    while(word_end < text.size() && !isspace((unsigned char)text[word_end]) && text[word_end] != '=') word_end++;
+    const std::string_view word = text.substr(0, word_end);
+    const std::string_view rest = trim(text.substr(word_end));
+
+    if(!rest.empty() && rest[0] == '=') {
+        AsmValue value;
+        if(word.empty() || identifier_length(word) != word.size()) {
+            error("bad constant name " + std::string(word));
+        } else if(parse_value(rest.substr(1), value)) {
+            if(!value.known()) error("constants can only use symbols defined before them");
+            else define(word, value.constant);
+        }
+    } else if(word[0] == '.') {
+        directive(word, rest);
+    } else {
+        instruction(word, rest);
+    }
+}
+
+void Assembly::resolve() {
+    for(const auto &fixup : fixups) {
+        const auto symbol = image.symbols.find(fixup.symbol);
+
+        line = fixup.line;
+        if(symbol == image.symbols.end()) {
+            error("undefined symbol " + fixup.symbol);
+            continue;
+        }
+
+        AsmValue value;
+        value.constant = symbol->second + fixup.addend;
+        field(fixup.address, fixup.shift, fixup.bits, fixup.relative, value);
+    }
+    fixups.clear();
+}
+
+bool assemble(const char *text, const size_t size, AsmImage &image) {
+    Assembly assembly(image);
+    const char *end = text + size;
+    unsigned line_number = 1;
+
+    image.words.clear();
+    image.symbols.clear();
+    image.errors.clear();
+
+    for(const char *line = text; line < end; line_number++) {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if(!eol) eol = end;
+
+        assembly.statement(std::string_view(line, eol - line), line_number);
+        line = eol + 1;
+    }
+    assembly.resolve();
+
+    return image.errors.empty();
+}
@@ -0,0 +1,44 @@
+#ifndef ASM_H_
+#define ASM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assembler for the instruction set, accepting what format_instruction()
+// prints. One line holds any number of "label:" prefixes and then an
+// instruction, a directive or a constant; ; and // start comments.
+//
+//   loop:   ADD r1, r2             registers r0..r15, case-insensitive mnemonics
+//           CMP r1, #LIMIT         #v: imm4 form if v is known and 0..15,
+//           LOAD r5, #$FF08            imm16 form if not, or if v starts with $
+//           JMP.NEQ loop           jumps take a bare target address,
+//           JMPR done                  JMPR #n a raw offset
+//   LIMIT = 10                     also .equ LIMIT, 10
+//           .org $0200             moves the output address forwards
+//           .word 1, $FFFF, loop
+//
+// Values are decimal, $hex or 0xhex, symbols, and sums and differences of
+// them. A symbol used before it is defined gets patched in when the whole
+// source has been read; it must be a label or constant plus or minus an
+// offset.
+
+struct AsmError {
+    unsigned line;
+    std::string message;
+};
+
+struct AsmImage {
+    uint16_t origin = 0x0100;           // address of words[0]
+    std::vector<uint16_t> words;        // gaps left by .org are zero
+    std::unordered_map<std::string, uint16_t> symbols;
+    std::vector<AsmError> errors;
+};
+
+// Assembles text into image, starting at image.origin. Returns true if there
+// were no errors.
+bool assemble(const char *text, const size_t size, AsmImage &image);
+
+#endif // ASM_H_
@@ -0,0 +1,80 @@
+#include <algorithm>
+
+#include "coverage.h"
+#include "isa.h"
+
+void Coverage::clear() {
+    std::fill(block_hits.begin(), block_hits.end(), 0);
+    std::fill(branches.begin(), branches.end(), 0);
+    block_start = true;
+}
+
+std::vector<uint64_t> Coverage::instruction_hits(const uint16_t *mem) const {
+    const uint32_t mem_size = block_hits.size();
+    std::vector<uint64_t> hits(mem_size);
+
+    for(uint32_t leader = 0; leader < mem_size; leader++) {
+        const uint64_t count = block_hits[leader];
+        if(!count) continue;
+
+        uint32_t address = leader;
+        while(address < mem_size) {
+            const Opcode &op = decode(mem[address]);
+
+            hits[address] += count;
+            if(op.words == 2 && address + 1 < mem_size) hits[address + 1] += count;
+
+            if(op.flow != FLOW_NEXT) break;
+            address += op.words;
+        }
+    }
+
+    return hits;
+}
+
+void Coverage::write_lcov(std::ostream &out, const std::string &source,
+                          const std::vector<ListingLine> &lines, const uint16_t *mem) const {
+    const uint32_t mem_size = block_hits.size();
+    const std::vector<uint64_t> hits = instruction_hits(mem);
+    unsigned lines_hit = 0, branches_found = 0, branches_hit = 0;
+
+    out << "TN:" << std::endl << "SF:" << source << std::endl;
+
+    // Branch sites, decoding the listing in order as the loader places it
+    for(size_t i = 0; i < lines.size(); i++) {
+        const uint16_t address = lines[i].address;
+        if(address >= mem_size) continue;
+
+        const uint16_t ir = mem[address];
+        const Opcode &op = decode(ir);
+
+        if(op.operands == OPERANDS_COND_ABS16 && (ir & 0x000F) != 0) {
+            const unsigned line = lines[i].line;
+            const uint8_t seen = branches[address];
+
+            if(hits[address]) {
+                out << "BRDA:" << line << ",0,0," << ((seen & BRANCH_TAKEN) ? 1 : 0) << std::endl;
+                out << "BRDA:" << line << ",0,1," << ((seen & BRANCH_NOT_TAKEN) ? 1 : 0) << std::endl;
+            } else {
+                out << "BRDA:" << line << ",0,0,-" << std::endl;
+                out << "BRDA:" << line << ",0,1,-" << std::endl;
+            }
+
+            branches_found += 2;
+            branches_hit += ((seen & BRANCH_TAKEN) ? 1 : 0) + ((seen & BRANCH_NOT_TAKEN) ? 1 : 0);
+        }
+
+        if(op.words == 2) i++;      // skip the immediate word
+    }
+
+    out << "BRF:" << branches_found << std::endl << "BRH:" << branches_hit << std::endl;
+
+    for(const auto &l : lines) {
+        const uint64_t count = (l.address < mem_size) ? hits[l.address] : 0;
+        out << "DA:" << l.line << "," << count << std::endl;
+        if(count) lines_hit++;
+    }
+
+    out << "LF:" << lines.size() << std::endl << "LH:" << lines_hit << std::endl;
+    out << "end_of_record" << std::endl;
+}
@@ -0,0 +1,53 @@
+#ifndef COVERAGE_H_
+#define COVERAGE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tools.h"
+
+// Direction bits recorded at each conditional branch
+#define BRANCH_TAKEN      (1u << 0)
+#define BRANCH_NOT_TAKEN  (1u << 1)
+
+// Basic-block coverage of guest code. The CPU counts each entry into a block
+// (at its first instruction) and records the directions taken at each JMP.cc;
+// per-instruction counts are only worked out when a report is written.
+class Coverage {
+
+    std::vector<uint64_t> block_hits;   // indexed by address of the block's first instruction
+    std::vector<uint8_t> branches;      // BRANCH_* bits, indexed by address of the JMP.cc
+    bool block_start = true;            // next instruction starts a block
+
+public:
+
+    Coverage(const uint32_t mem_size) : block_hits(mem_size), branches(mem_size) {}
+
+    // called by the CPU
+    void instruction(const uint16_t pc) {
+        if(block_start) {
+            block_hits[pc]++;
+            block_start = false;
+        }
+    }
+    void end_block() { block_start = true; }
+    void branch(const uint16_t pc, const bool taken) {
+        branches[pc] |= taken ? BRANCH_TAKEN : BRANCH_NOT_TAKEN;
+    }
+
+    void clear();
+
+    uint8_t branch_directions(const uint16_t pc) const { return branches[pc]; }
+
+    // Execution count of every address, found by walking each executed block
+    // in mem up to its closing jump. Immediate words count with their instruction.
+    std::vector<uint64_t> instruction_hits(const uint16_t *mem) const;
+
+    // Appends an lcov record for source, whose words are at the addresses in lines
+    void write_lcov(std::ostream &out, const std::string &source,
+                    const std::vector<ListingLine> &lines, const uint16_t *mem) const;
+};
+
+#endif // COVERAGE_H_
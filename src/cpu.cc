@@ -1,20 +1,43 @@
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <bitset>
+#include <cstdio>
 #include "cpu.h"
+#include "alu.h"
+#include "coverage.h"
+#include "device.h"
+#include "isa.h"
+#include "trace.h"
+#include "traps.h"
+#include "uarch.h"
+
+CPU::CPU(const uint32_t mem_size) : mem_size(mem_size) {
+    MEM = new uint16_t[mem_size];
+    install_builtin_traps(*this);
+}
 
 void CPU::reset() {
     FLAGS = 0;
+    FAULT = FAULT_NONE;
     SP = SPX = 0;
     PC = 0x100;        // Start address for code
 
     for(auto &reg : REG) { reg = 0; }    // Zero out registers
+    for(auto &ctr : COUNTER) { ctr = 0; }
+    for(auto &ctr : LATCH) { ctr = 0; }
 
     trace_instructions = false;
+    if(coverage) coverage->end_block();
 
     return;
 }
 
+void CPU::setPC(const uint16_t location) {
+    PC = location;
+    if(coverage) coverage->end_block();    // execution resumes in a new block
+}
+
 void CPU::loadmem(const uint16_t *buffer, const uint16_t size, const uint16_t start) {
     const uint16_t size_norm = (size > mem_size - start) ? mem_size - start : size;
     memcpy((MEM + start), buffer, size_norm);
@@ -24,9 +47,66 @@ uint16_t CPU::getmem_at(const uint16_t position) const {
     return MEM[position];
 }
 
+void CPU::attach_device(Device *device, const uint16_t base, const uint16_t count) {
+    ports.push_back({base, count, device});
+}
+
+uint16_t CPU::port_read(const uint16_t port) {
+    for(const auto &mapping : ports) {
+        if((uint16_t)(port - mapping.base) < mapping.count)
+            return mapping.device->read(port - mapping.base);
+    }
+    return 0xFFFF;
+}
+
+void CPU::port_write(const uint16_t port, const uint16_t value) {
+    for(const auto &mapping : ports) {
+        if((uint16_t)(port - mapping.base) < mapping.count) {
+            mapping.device->write(port - mapping.base, value);
+            return;
+        }
+    }
+}
+
+void CPU::tick_devices() {
+    for(const auto &mapping : ports) mapping.device->tick();
+}
+
+void CPU::set_snoop(Device *device, std::initializer_list<SnoopRange> ranges) {
+    snoop_device = device;
+
+    unsigned i = 0;
+    for(const auto &range : ranges) {
+        if(device && i < SNOOP_RANGES) snoop_ranges[i++] = range;
+    }
+    for(; i < SNOOP_RANGES; i++) snoop_ranges[i] = SnoopRange();
+}
+
+inline void CPU::snoop(const uint16_t address) {
+    for(const auto &range : snoop_ranges) {
+        if((uint16_t)(address - range.start) < range.count) {
+            snoop_device->snoop(address);
+            return;
+        }
+    }
+}
+
+void CPU::snoop_range(const uint16_t start, const uint32_t count) {
+    const uint32_t end = (uint32_t)start + count;
+
+    // The device may stop watching, or watch other ranges, once it has acted
+    for(unsigned i = 0; i < SNOOP_RANGES; i++) {
+        const SnoopRange range = snoop_ranges[i];
+        const uint32_t watched_end = (uint32_t)range.start + range.count;
+
+        if(count && range.count && start < watched_end && range.start < end)
+            snoop_device->snoop(std::max(start, range.start));
+    }
+}
+
 void CPU::dump_memory() const {
     std::cout << std::right << std::setbase(16) << std::noshowbase << std::setfill('0');
-    for(int i = 0; i < mem_size; i++) {
+    for(uint32_t i = 0; i < mem_size; i++) {
         if(i % 16 == 0) std::cout << std::setw(4) << i << " : ";
         std::cout << std::setw(4) << MEM[i] << " ";
         if(i % 16 == 15) std::cout << std::endl;
@@ -51,87 +131,47 @@ void CPU::dump_flags() const {
     std::cout << "FLAGS: " << flag_bitfield << std::endl;
 }
 
-void CPU::update_flags(uint32_t val) {
-    if(val == 0) {
-        FLAGS |= FLAGS_ZERO;
-    } else {
-        FLAGS &= ~FLAGS_ZERO;
-    }
+uint16_t CPU::disassemble(const uint16_t address, char *out) const {
+    const uint16_t ext = ((uint32_t)address + 1 < mem_size) ? MEM[address + 1] : 0;
+    format_instruction(MEM[address], ext, out);
+    return decode(MEM[address]).words;
+}
 
-    if(val & 0x8000) {
-        FLAGS |= FLAGS_NEG;
-    } else {
-        FLAGS &= ~FLAGS_NEG;
-    }
+size_t CPU::disassemble(const uint16_t start, const uint32_t end,
+                        char *out, const size_t out_size, uint32_t *next) const {
+    return disassemble_range(MEM, mem_size, start, end, out, out_size, next);
 }
 
-void CPU::update_flags_arithmetic(uint32_t val, uint16_t op1, uint16_t op2) {
-    if(val > 0xFFFF) {
-        FLAGS |= FLAGS_CARRY;
-    } else {
-        FLAGS &= ~FLAGS_CARRY;
-    }
+void CPU::trace(const uint16_t address) const {
+    char line[DISASM_INSTRUCTION_MAX + 24];
 
-    //(~(a ^ b))&(a ^ c)&0x80
-    if( (~(op1 ^ op2)) & (op1 ^ val) & 0x8000 ) {
-        FLAGS |= FLAGS_OVERFLOW;
-    } else {
-        FLAGS &= ~FLAGS_OVERFLOW;
-    }
+    int len = snprintf(line, sizeof(line), "PC = %04X    %04X    ", address, MEM[address]);
+    disassemble(address, line + len);
+    len += strlen(line + len);
+    line[len++] = '\n';
+
+    std::cout.write(line, len);
+}
+
+void CPU::dump_counters() const {
+    std::cout << std::setbase(10)
+              << "RETIRED=" << COUNTER[COUNTER_RETIRED]
+              << " BRANCHES=" << COUNTER[COUNTER_BRANCHES]
+              << " LOADS=" << COUNTER[COUNTER_LOADS]
+              << " STORES=" << COUNTER[COUNTER_STORES] << std::endl;
+}
+
+void CPU::update_flags(uint32_t val) {
+    FLAGS = alu_flags_zn(FLAGS, val);
+}
+
+void CPU::update_flags_arithmetic(uint32_t val, uint16_t op1, uint16_t op2) {
+    FLAGS = alu_flags_cv(FLAGS, val, op1, op2);
 }
 
 std::string CPU::condition_to_letters(uint16_t condition) const {
     // We only compare the relevant 4-bits
-    switch(condition & 0x000F) {
-        case 0b0000:            // No condition
-            return std::string("");
-            break;
-        case 0b0001:            // Equality / zero
-            return std::string(".EQ");
-            break;
-        case 0b0010:            // Below (unsigned)
-            return std::string(".B");
-            break;
-        case 0b0011:            // Below or equal
-            return std::string(".BE");
-            break;
-        case 0b0100:            // Less (signed)
-            return std::string(".L");
-            break;
-        case 0b0101:            // Less or equal
-            return std::string(".LE");
-            break;
-        case 0b0110:            // Negative
-            return std::string(".N");
-            break;
-        case 0b0111:            // Overflow
-            return std::string(".V");
-            break;
-        case 0b1001:            // Not equal
-            return std::string(".NEQ");
-            break;
-        case 0b1010:            // Above or equal
-            return std::string(".AE");
-            break;
-        case 0b1011:            // Above
-            return std::string(".A");
-            break;
-        case 0b1100:            // Greater than
-            return std::string(".G");
-            break;
-        case 0b1101:            // Greater or equal
-            return std::string(".GE");
-            break;
-        case 0b1110:            // Not negative (positive)
-            return std::string(".P");
-            break;
-        case 0b1111:            // Not overflow
-            return std::string(".NV");
-            break;
-        default:                // Undefined
-            return std::string("UNDEFINED");
-            break;
-    }
+    return std::string(condition_suffix[condition & 0x000F]);
 }
 
 bool CPU::check_condition(uint16_t condition) const {
@@ -199,36 +239,31 @@ void CPU::run_once() {
     // Decode instruction into opcode and parameters
     uint16_t opcode = (IR & OPCODE_MASK) >> 8;
     uint16_t params = IR & PARAM_MASK;
+    bool retired = true;        // an illegal opcode or unhandled trap does not retire
 
-    if(trace_instructions) std::cout << "PC = "
-              << std::right << std::hex << std::setfill('0') << std::uppercase
-              << std::setw(4) << initial_pc << "    "
-              << std::setw(4) << IR << "    ";
-//              << "opcode=" << std::setw(2) << opcode << "   "
-//              << "params=" << std::setw(2) << params << "   ";
+    if(trace_instructions) trace(initial_pc);
+    if(coverage) coverage->instruction(initial_pc);
 
     // Execute
     // std::cout << "Running : ";
     if(opcode == 0xFF)          // NOP
     {
-        if(trace_instructions) std::cout << "NOP" << std::endl;
     }
     else if(opcode == 0xF8)     // HALT
     {
         halt();
-
-        if(trace_instructions) std::cout << "HALT" << std::endl;
     }
     else if(opcode == 0x00)     // LOAD indirect  REG[param_high] <- (REG[param_low])
     {
         uint16_t add = (params & 0x000F);
         uint16_t reg = (params >> 4) & 0x000F;
 
+        snoop(REG[add]);
+        if(uarch) uarch->record(REG[add], EVENT_READ);
         uint16_t val = REG[reg] = MEM[REG[add]];
         update_flags(val);
 
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "LOAD r" << reg << ", (r" << add << ")" << std::endl;
+        COUNTER[COUNTER_LOADS]++;
     }
     else if(opcode == 0x01)     // LOAD immediate REG[param_high] <- imm4[param_low]
     {
@@ -238,9 +273,6 @@ void CPU::run_once() {
         uint16_t val = REG[reg] = imm;
 
         update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "LOAD r" << reg << ", #" << imm << std::endl;
     }
     else if(opcode == 0x02)     // LOAD register REG[param_high] <- REG[param_low]
     {
@@ -250,9 +282,6 @@ void CPU::run_once() {
         uint16_t val = REG[dst] = REG[src];
 
         update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "LOAD r" << dst << ", r" << src << std::endl;
     }
     else if(opcode == 0x03)     // LOAD immediate REG[param_high] <- imm16
     {
@@ -262,153 +291,94 @@ void CPU::run_once() {
         uint16_t val = REG[reg] = imm;
 
         update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "LOAD r" << reg << ", #$" << std::setbase(16) << imm << std::endl;
     }
     else if(opcode == 0x10)     // STORE indirect (REG[param_high]) <- REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t add = (params >> 4) & 0x000F;
 
+        snoop(REG[add]);
+        if(uarch) uarch->record(REG[add], EVENT_WRITE);
         uint16_t val = MEM[REG[add]] = REG[reg];
 
         update_flags(val);
 
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "STORE (r" << add << "), r" << reg << std::endl;
+        COUNTER[COUNTER_STORES]++;
     }
     else if(opcode == 0x11)     // STORE indirect (REG[param_high]) <- imm4[param_low]
     {
         uint16_t add = (params & 0x000F);
         uint16_t imm = (params >> 4) & 0x000F;
 
+        snoop(REG[add]);
+        if(uarch) uarch->record(REG[add], EVENT_WRITE);
         uint16_t val = MEM[REG[add]] = imm;
 
         update_flags(val);
 
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "STORE (r" << add << "), " << imm << std::endl;
+        COUNTER[COUNTER_STORES]++;
     }
     else if(opcode == 0x20)     // ADD REG[param_high] <- REG[param_high] + REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint16_t op1 = REG[acc];
-        uint16_t op2 = REG[reg];
-
-        uint32_t val = REG[acc] += REG[reg];
-
-        update_flags(val);
-        update_flags_arithmetic(val, op1, op2);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "ADD r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_add(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x21)     // ADC REG[param_high] <- REG[param_high] + REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        if(carry()) ++REG[acc];
-
-        uint16_t op1 = REG[acc];
-        uint16_t op2 = REG[reg];
-
-        uint32_t val = REG[acc] += REG[reg];
-
-        update_flags(val);
-        update_flags_arithmetic(val, op1, op2);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "ADD r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_adc(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x30)     // NOT REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
 
-        uint32_t val = REG[reg] = ~REG[reg];
-
-        update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "NOT r" << reg << std::endl;
+        FLAGS = alu_not(REG[reg], FLAGS);
     }
     else if(opcode == 0x31)     // AND REG[param_high] <- REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint32_t val = REG[acc] &= REG[reg];
-
-        update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "AND r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_and(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x32)     // OR REG[param_high] <- REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint32_t val = REG[acc] |= REG[reg];
-
-        update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "OR r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_or(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x33)     // XOR REG[param_high] <- REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint32_t val = REG[acc] ^= REG[reg];
-
-        update_flags(val);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "XOR r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_xor(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x40)     // CMP REG[param_high], REG[param_low]
     {
         uint16_t reg = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint32_t val = (REG[acc] - REG[reg]);
-
-        update_flags(val);
-        update_flags_arithmetic(val, REG[acc], REG[reg]);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "CMP r" << acc << ", r" << reg << std::endl;
+        FLAGS = alu_cmp(REG[acc], REG[reg], FLAGS);
     }
     else if(opcode == 0x41)     // CMP REG[param_high], imm4[param_low]
     {
         uint16_t imm = (params & 0x000F);
         uint16_t acc = (params >> 4) & 0x000F;
 
-        uint32_t val = (REG[acc] - imm);
-
-        update_flags(val);
-        update_flags_arithmetic(val, REG[acc], imm);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "CMP r" << acc << ", " << imm << std::endl;
+        FLAGS = alu_cmp(REG[acc], imm, FLAGS);
     }
     else if(opcode == 0x42)     // CMP immediate REG[param_high], imm16
     {
         uint16_t acc = (params >> 4) & 0x000F;
         uint16_t imm = MEM[PC++];
 
-        uint32_t val = (REG[acc] - imm);
-
-        update_flags(val);
-        update_flags_arithmetic(val, REG[acc], imm);
-
-        if(trace_instructions)
-            std::cout << std::setbase(10) << "CMP r" << acc << ", #$" << std::setbase(16) << imm << std::endl;
+        FLAGS = alu_cmp(REG[acc], imm, FLAGS);
     }
     else if(opcode == 0x50)     // JMPR rel [signed param]
     {
@@ -416,25 +386,107 @@ void CPU::run_once() {
 
         PC += rel;              // JMPR 0 is a nop
 
-        if(trace_instructions)
-            std::cout << "JMPR #$" << std::setbase(16) << rel << std::endl;
+        COUNTER[COUNTER_BRANCHES]++;
     }
     else if(opcode == 0x51)     // JMP ABS imm16
     {
         uint16_t abs = MEM[PC++];
 
-        if(check_condition(params))
+        bool taken = check_condition(params);
+        if(taken) {
             PC = abs;
+            COUNTER[COUNTER_BRANCHES]++;
+        }
+
+        if(coverage && (params & 0x000F)) coverage->branch(initial_pc, taken);
+        if(uarch && (params & 0x000F))
+            uarch->record(initial_pc, taken ? EVENT_BRANCH_TAKEN : EVENT_BRANCH_NOT_TAKEN);
+    }
+    else if(opcode == 0x60)     // RDCTR REG[param_high] <- word (param_low & 3) of counter (param_low >> 2)
+    {
+        uint16_t word = (params & 0x0003);
+        uint16_t ctr = (params >> 2) & 0x0003;
+        uint16_t reg = (params >> 4) & 0x000F;
+
+        // Reading the low word latches the whole counter, so that the
+        // following reads of the upper words are consistent with it
+        if(word == 0) LATCH[ctr] = COUNTER[ctr];
+
+        uint16_t val = REG[reg] = LATCH[ctr] >> (16 * word);
+
+        update_flags(val);
+    }
+    else if(opcode == 0x70)     // TRAP #param: call host handler
+    {
+        if(traps[params]) {
+            bool ok = traps[params](*this);
+
+            update_flags(REG[0]);
+            if(ok) {
+                FLAGS &= ~FLAGS_CARRY;
+            } else {
+                FLAGS |= FLAGS_CARRY;
+            }
+        } else {
+            halt(FAULT_UNHANDLED_TRAP);
+            retired = false;
+        }
+    }
+    else if(opcode == 0x80)     // OUT port (REG[param_high]) <- REG[param_low]
+    {
+        uint16_t reg = (params & 0x000F);
+        uint16_t port = (params >> 4) & 0x000F;
 
-        if(trace_instructions)
-            std::cout << "JMP" << condition_to_letters(params)
-                      << " #$" <<  std::setbase(16) << abs << std::endl;
+        port_write(REG[port], REG[reg]);
+    }
+    else if(opcode == 0x81)     // IN REG[param_high] <- port (REG[param_low])
+    {
+        uint16_t port = (params & 0x000F);
+        uint16_t reg = (params >> 4) & 0x000F;
+
+        uint16_t val = REG[reg] = port_read(REG[port]);
+
+        update_flags(val);
     }
     else                        // Illegal opcode: halt CPU for now, maybe add trapping later
     {
-        halt();
-        std::cout << "Illegal opcode: CPU halted" << std::endl;
+        halt(FAULT_ILLEGAL_OPCODE);
+        retired = false;
+    }
+
+    if(retired) COUNTER[COUNTER_RETIRED]++;
+
+    if(--tick_countdown == 0) {
+        tick_countdown = DEVICE_TICK_INSTRUCTIONS;
+        tick_devices();
+    }
+
+    if(coverage && decode(IR).flow != FLOW_NEXT) coverage->end_block();
+
+    if(uarch) {
+        // Instruction fetches, including the immediate word of two-word instructions
+        uarch->record(initial_pc, EVENT_FETCH);
+        if(decode(IR).words == 2) uarch->record(initial_pc + 1, EVENT_FETCH);
+    }
+
+    if(trace_sink) {
+        const uint16_t ext = ((uint32_t)initial_pc + 1 < mem_size) ? MEM[initial_pc + 1] : 0;
+        trace_sink->push(initial_pc, IR, ext, FLAGS);
     }
 
     return;
 }
+
+uint64_t CPU::run(const uint64_t budget) {
+    uint64_t count = 0;
+
+    while(count < budget && !halted()) {
+        const uint16_t pc = PC;
+
+        run_once();
+        count++;
+        progress.store((COUNTER[COUNTER_RETIRED] << 16) | pc, std::memory_order_relaxed);
+    }
+
+    return count;
+}
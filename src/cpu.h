@@ -1,9 +1,14 @@
 #ifndef CPU_H_
 #define CPU_H_
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <string>
+#include <vector>
 
 // CPU flags
 
@@ -17,15 +22,51 @@
 
 #define FLAGS_COND     (FLAGS_ZERO | FLAGS_NEG | FLAGS_OVERFLOW | FLAGS_CARRY)
 
+// Performance counters, readable by guest code with RDCTR
+
+#define COUNTER_RETIRED   0     // instructions retired (one per cycle: there is no cycle model)
+#define COUNTER_BRANCHES  1     // taken jumps
+#define COUNTER_LOADS     2     // data reads from memory
+#define COUNTER_STORES    3     // data writes to memory
+#define COUNTERS          4
+
+// Why the CPU last halted: FAULT_NONE for HALT, or the fault that stopped it
+
+#define FAULT_NONE            0
+#define FAULT_ILLEGAL_OPCODE  1
+#define FAULT_UNHANDLED_TRAP  2     // TRAP #n with no handler registered
+
+// Instructions between two calls to the devices' tick()
+#define DEVICE_TICK_INSTRUCTIONS 64
+
+// Memory ranges a device can ask the CPU to watch at once
+#define SNOOP_RANGES 2
+
 // Opcode mask
 #define OPCODE_MASK    (0xFF00)
 #define PARAM_MASK     (0x00FF)
 
+class TraceSink;
+class Coverage;
+class Device;
+class Uarch;
+class CPU;
+
+// Addresses start .. start + count - 1 of guest memory
+struct SnoopRange {
+    uint16_t start = 0;
+    uint32_t count = 0;
+};
+
+// Host handler for TRAP #n. Arguments are in r1..r3 and the result goes in
+// r0; returning false reports an error to the guest through the carry flag.
+typedef std::function<bool(CPU &)> TrapHandler;
+
 // CPU with mem_size bytes of memory
 
 class CPU {
 
-    const uint16_t mem_size; // size of system memory
+    const uint32_t mem_size; // size of system memory
     uint16_t *MEM;        // system memory
 
     uint16_t PC;          // Program Counter
@@ -34,15 +75,39 @@ class CPU {
     uint16_t SP, SPX;     // stack pointer and shadow stack pointer
 
     uint16_t IR;          // internal instruction register
+    uint16_t FAULT;       // FAULT_*, set when the CPU halts
+
+    uint64_t COUNTER[COUNTERS];   // performance counters
+    uint64_t LATCH[COUNTERS];     // counter values latched by RDCTR for multi-word reads
 
     bool trace_instructions;    // CPU displays instructions executed when enabled
+    TraceSink *trace_sink = nullptr;    // binary trace of instructions executed, if set
+    Coverage *coverage = nullptr;       // basic-block coverage, if set
+    Uarch *uarch = nullptr;             // microarchitecture analysis, if set
+
+    std::array<TrapHandler, 256> traps; // TRAP handlers, by trap number
+
+    struct PortMapping {
+        uint16_t base;
+        uint16_t count;
+        Device *device;
+    };
+    std::vector<PortMapping> ports;     // I/O port bus
+    unsigned tick_countdown = DEVICE_TICK_INSTRUCTIONS;
 
-    void halt() { FLAGS |= FLAGS_HALT; }
+    std::atomic<uint64_t> progress{0};  // (retired << 16) | address, published by run()
+
+    Device *snoop_device = nullptr;     // device watching the snoop_ranges
+    SnoopRange snoop_ranges[SNOOP_RANGES];
+
+    void halt(const uint16_t fault = FAULT_NONE) { FLAGS |= FLAGS_HALT; FAULT = fault; }
+    void trace(const uint16_t address) const;
+    void snoop(const uint16_t address);
 
 public:
 
-    CPU(const uint16_t mem_size) : mem_size(mem_size) { MEM = new uint16_t[mem_size]; }
-    ~CPU() { delete MEM; }
+    CPU(const uint32_t mem_size);
+    ~CPU() { delete[] MEM; }
 
     // initialization
     void reset();
@@ -50,26 +115,71 @@ public:
     // run one CPU instruction
     void run_once();
 
+    // run up to budget instructions, stopping early if the CPU halts;
+    // returns the number run
+    uint64_t run(const uint64_t budget);
+
+    // lock-free snapshot of a running CPU for other threads: the low 16 bits
+    // are the address of the last instruction run() executed and the rest
+    // the instructions retired once it had
+    uint64_t progress_snapshot() const { return progress.load(std::memory_order_relaxed); }
+
     // functions representing the CPU pinout & I/O
     // ...
 
+    // I/O ports: the device answers for ports base .. base + count - 1. Unmapped
+    // ports read as FFFF and ignore writes. Devices are owned by the caller.
+    void attach_device(Device *device, const uint16_t base, const uint16_t count);
+    uint16_t port_read(const uint16_t port);
+    void port_write(const uint16_t port, const uint16_t value);
+    void tick_devices();
+
+    // a device asks to see guest data accesses to up to SNOOP_RANGES ranges
+    // (none, or a null device: stop watching)
+    void set_snoop(Device *device, std::initializer_list<SnoopRange> ranges);
+
+    // host code about to access [start, start + count) for the guest, as TRAP
+    // handlers do, lets the snooping device act first as for a guest access
+    void snoop_range(const uint16_t start, const uint32_t count);
+
+    // host calls: TRAP #number runs handler (an empty handler removes it)
+    void register_trap(const uint8_t number, TrapHandler handler) { traps[number] = std::move(handler); }
+
     // getters & setters
     uint16_t flags() const { return FLAGS; }
+    void setflags(const uint16_t value) { FLAGS = value; }
     bool halted() const { return (FLAGS & FLAGS_HALT); }
+    uint16_t fault() const { return FAULT; }
     bool carry() const { return (FLAGS & FLAGS_CARRY); }
     bool overflow() const { return (FLAGS & FLAGS_OVERFLOW); }
     bool negative() const { return (FLAGS & FLAGS_NEG); }
     bool zero() const { return (FLAGS & FLAGS_ZERO); }
 
+    // value of a COUNTER_* counter, 0 for an index that names none
+    uint64_t counter(const unsigned index) const { return index < COUNTERS ? COUNTER[index] : 0; }
+
+    uint16_t getreg(const unsigned index) const { return REG[index & 0x000F]; }
+    void setreg(const unsigned index, const uint16_t value) { REG[index & 0x000F] = value; }
+
     uint16_t getPC() const { return PC; }
-    void setPC(const uint16_t location) { PC = location; }
+    void setPC(const uint16_t location);
 
     void loadmem(const uint16_t *buffer, const uint16_t size, const uint16_t start);
     uint16_t getmem_at(const uint16_t) const;
+    const uint16_t *memory() const { return MEM; }
+    uint16_t *memory() { return MEM; }
+    uint32_t memory_size() const { return mem_size; }
 
     void dump_memory() const;
     void dump_registers() const;
     void dump_flags() const;
+    void dump_counters() const;
+
+    // disassembly: single instruction into out (DISASM_INSTRUCTION_MAX bytes),
+    // returning its length in words, or a whole range as text lines
+    uint16_t disassemble(const uint16_t address, char *out) const;
+    size_t disassemble(const uint16_t start, const uint32_t end,
+                       char *out, const size_t out_size, uint32_t *next) const;
 
     std::string condition_to_letters(uint16_t) const;
     bool check_condition(uint16_t) const;
@@ -79,6 +189,14 @@ public:
 
     void toggle_tracing() { trace_instructions = !trace_instructions; }
     bool tracing() { return trace_instructions; }
+
+    // the sink is owned by the caller and must outlive its use by the CPU
+    void set_trace_sink(TraceSink *sink) { trace_sink = sink; }
+    TraceSink *get_trace_sink() const { return trace_sink; }
+
+    // same ownership rules as the trace sink
+    void set_coverage(Coverage *cov) { coverage = cov; }
+    void set_uarch(Uarch *analysis) { uarch = analysis; }
 };
 
 
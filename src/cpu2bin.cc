@@ -1,18 +1,240 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <filesystem>
+namespace fs = std::filesystem;
 
 #include "tools.h"
 
+#define MANIFEST_NAME ".cpu2bin.manifest"
+
+static void usage() {
+    std::cout << "Usage: cpu2bin input.cpu output.bin" << std::endl
+              << "       cpu2bin -o outdir [-j threads] [-a] input.cpu|directory..." << std::endl
+              << "    -o outdir   batch mode: convert every input, and every .cpu file under the" << std::endl
+              << "                directories, to a .bin at the same relative path in outdir" << std::endl
+              << "    -j threads  worker threads (default: all cores)" << std::endl
+              << "    -a          convert all inputs, even those unchanged since the last run" << std::endl;
+}
+
+// 64-bit FNV-1a
+static uint64_t content_hash(const std::string &data) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static bool write_words(const fs::path &filename, const std::vector<uint16_t> &words) {
+    std::ofstream output_file(filename, std::ios::binary);
+    if(!output_file) return false;
+
+    output_file.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint16_t));
+    return output_file.good();
+}
+
+struct Job {
+    fs::path input, output;
+    std::string key;                // output path relative to outdir, for the manifest
+    enum { PENDING, CONVERTED, UNCHANGED, FAILED } result = PENDING;
+    uint64_t hash = 0;
+    uint64_t bytes_in = 0, bytes_out = 0;
+};
+
+// Manifest lines are "<hash> <key>": the content hash of the input that
+// produced outdir/key
+static std::map<std::string, uint64_t> read_manifest(const fs::path &filename) {
+    std::map<std::string, uint64_t> manifest;
+    std::ifstream file(filename);
+    std::string key;
+    uint64_t hash;
+
+    while(file >> std::hex >> hash && file.get() == ' ' && std::getline(file, key)) manifest[key] = hash;
+    return manifest;
+}
+
+// Entries of outputs this run did not touch are carried over from previous,
+// so converting a few files does not make the next full run redo the rest
+static bool write_manifest(const fs::path &filename, const std::map<std::string, uint64_t> &previous,
+                           const std::vector<Job> &jobs) {
+    std::map<std::string, uint64_t> manifest = previous;
+    for(const auto &job : jobs) {
+        if(job.result == Job::CONVERTED || job.result == Job::UNCHANGED) {
+            manifest[job.key] = job.hash;
+        } else {
+            manifest.erase(job.key);
+        }
+    }
+
+    const fs::path temporary = filename.string() + ".tmp";
+    std::ofstream file(temporary);
+
+    for(const auto &[key, hash] : manifest)
+        file << std::hex << std::setw(16) << std::setfill('0') << hash << ' ' << key << '\n';
+    file.close();
+    if(!file) return false;
+
+    std::error_code error;
+    fs::rename(temporary, filename, error);
+    return !error;
+}
+
+static void run_job(Job &job, const std::map<std::string, uint64_t> &manifest, const bool all) {
+    std::string text;
+    std::vector<uint16_t> words;
+
+    if(!read_whole_file(job.input.string(), text)) {
+        job.result = Job::FAILED;
+        return;
+    }
+    job.bytes_in = text.size();
+    job.hash = content_hash(text);
+
+    const auto cached = manifest.find(job.key);
+    if(!all && cached != manifest.end() && cached->second == job.hash && fs::exists(job.output)) {
+        job.result = Job::UNCHANGED;
+        return;
+    }
+
+    std::error_code error;
+    fs::create_directories(job.output.parent_path(), error);
+
+    if(!parse_listing(text.data(), text.size(), words) || !write_words(job.output, words)) {
+        job.result = Job::FAILED;
+        return;
+    }
+    job.bytes_out = words.size() * sizeof(uint16_t);
+    job.result = Job::CONVERTED;
+}
+
+// Converts many inputs in parallel. Returns the exit status.
+static int convert_batch(const std::vector<std::string> &inputs, const fs::path &outdir,
+                         const unsigned threads, const bool all)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Job> jobs;
+
+    for(const auto &input : inputs) {
+        std::error_code error;
+
+        if(fs::is_directory(input, error)) {
+            for(const auto &entry : fs::recursive_directory_iterator(input, error)) {
+                if(!entry.is_regular_file() || entry.path().extension() != ".cpu") continue;
+                fs::path relative = fs::relative(entry.path(), input).replace_extension(".bin");
+                jobs.push_back({entry.path(), outdir / relative, relative.generic_string()});
+            }
+        } else {
+            fs::path name = fs::path(input).filename().replace_extension(".bin");
+            jobs.push_back({input, outdir / name, name.generic_string()});
+        }
+        if(error) {
+            std::cerr << "Could not read " << input << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, const Job *> outputs;
+    for(const auto &job : jobs) {
+        auto [other, added] = outputs.emplace(job.key, &job);
+        if(!added) {
+            std::cerr << job.input.string() << " and " << other->second->input.string()
+                      << " would both be converted to " << job.key << std::endl;
+            return 1;
+        }
+    }
+
+    const fs::path manifest_filename = outdir / MANIFEST_NAME;
+    const std::map<std::string, uint64_t> manifest = read_manifest(manifest_filename);
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for(size_t i; (i = next++) < jobs.size();) run_job(jobs[i], manifest, all);
+    };
+    std::vector<std::thread> pool;
+    for(unsigned i = 1; i < std::min<size_t>(threads, jobs.size()); i++) pool.emplace_back(worker);
+    worker();
+    for(auto &thread : pool) thread.join();
+
+    unsigned converted = 0, unchanged = 0, failed = 0;
+    uint64_t bytes_in = 0, bytes_out = 0;
+    for(const auto &job : jobs) {
+        if(job.result == Job::CONVERTED) converted++;
+        if(job.result == Job::UNCHANGED) unchanged++;
+        if(job.result == Job::FAILED) {
+            failed++;
+            std::cerr << "Could not convert " << job.input.string() << std::endl;
+        }
+        bytes_in += job.bytes_in;
+        bytes_out += job.bytes_out;
+    }
+
+    if(!jobs.empty() && !write_manifest(manifest_filename, manifest, jobs)) {
+        std::cerr << "Could not write " << manifest_filename.string() << std::endl;
+        failed++;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Converted " << converted << ", unchanged " << unchanged << ", failed " << failed
+              << ": read " << bytes_in << " bytes, wrote " << bytes_out << " bytes in "
+              << std::fixed << std::setprecision(3) << elapsed.count() << " s ("
+              << std::setprecision(1) << bytes_in / elapsed.count() / 1e6 << " MB/s)" << std::endl;
+
+    return failed ? 1 : 0;
+}
+
 /* Converts a .cpu file containing a list of hex words to binary */
 int main(int argc, char **argv)
 {
-    if(argc != 3) {
-        std::cout << "Usage: cpu2bin input.cpu output.bin" << std::endl;
+    std::string outdir;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    bool all = false;
+    std::vector<std::string> files;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if(arg == "-o" && i + 1 < argc) {
+            outdir = argv[++i];
+        } else if(arg == "-j" && i + 1 < argc) {
+            try {
+                threads = std::stoul(argv[++i]);
+            } catch(std::logic_error const &e) {
+                threads = 0;
+            }
+        } else if(arg == "-a") {
+            all = true;
+        } else if(arg[0] == '-') {
+            usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if(!outdir.empty()) {
+        if(files.empty() || threads == 0) {
+            usage();
+            return 1;
+        }
+        return convert_batch(files, outdir, threads, all);
+    }
+
+    if(files.size() != 2) {
+        usage();
         return 1;
     }
 
-    std::string input_filename(argv[1]);
-    std::string output_filename(argv[2]);
+    std::string input_filename(files[0]);
+    std::string output_filename(files[1]);
 
     const uint16_t buffer_size = 65535;
     uint16_t buffer[buffer_size];
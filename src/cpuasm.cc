@@ -0,0 +1,76 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "asm.h"
+#include "tools.h"
+
+#define MAX_ERRORS_SHOWN 20
+
+static void usage() {
+    std::cout << "Usage: cpuasm [-l location] input.asm output.bin" << std::endl
+              << "    -l location  address of the first word, in hex, unless the source starts" << std::endl
+              << "                 with .org (0100 if not specified)" << std::endl;
+}
+
+/* Assembles a source file into a binary image */
+int main(int argc, char **argv)
+{
+    AsmImage image;
+    std::vector<std::string> files;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if(arg == "-l" && i + 1 < argc) {
+            try {
+                image.origin = std::stoul(argv[++i], nullptr, 16);
+            } catch(std::logic_error const &e) {
+                std::cerr << "Could not parse address: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if(arg[0] == '-') {
+            usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if(files.size() != 2) {
+        usage();
+        return 1;
+    }
+
+    std::string source;
+    if(!read_whole_file(files[0], source)) {
+        std::cerr << "Could not read " << files[0] << std::endl;
+        return 1;
+    }
+
+    if(!assemble(source.data(), source.size(), image)) {
+        for(size_t i = 0; i < image.errors.size() && i < MAX_ERRORS_SHOWN; i++)
+            std::cerr << files[0] << ":" << image.errors[i].line << ": " << image.errors[i].message << std::endl;
+        if(image.errors.size() > MAX_ERRORS_SHOWN)
+            std::cerr << "... and " << image.errors.size() - MAX_ERRORS_SHOWN << " more errors" << std::endl;
+        return 1;
+    }
+
+    std::ofstream output_file(files[1], std::ios::binary);
+    if(!output_file) {
+        std::cerr << "Could not open " << files[1] << " for writing" << std::endl;
+        return 1;
+    }
+
+    output_file.write(reinterpret_cast<const char *>(image.words.data()), image.words.size() * sizeof(uint16_t));
+    output_file.close();
+    if(!output_file) {
+        std::cerr << "Could not write " << files[1] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << image.words.size() * sizeof(uint16_t) << " bytes to " << files[1]
+              << ", to be loaded at " << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+              << image.origin << std::endl;
+    return 0;
+}
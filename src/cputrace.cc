@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "isa.h"
+#include "trace.h"
+
+#define RECORDS_PER_READ 65536
+
+static void usage() {
+    std::cout << "Usage: cputrace [-b] [-f from] [-t to] input.trace [output]" << std::endl
+              << "    -b       write a binary trace instead of text" << std::endl
+              << "    -f from  only keep instructions at PC >= from (hex)" << std::endl
+              << "    -t to    only keep instructions at PC <= to (hex)" << std::endl;
+}
+
+/* Converts a binary trace written by the emulator to text, or filters it by PC range */
+int main(int argc, char **argv)
+{
+    bool binary = false;
+    uint32_t from = 0x0000, to = 0xFFFF;
+    std::vector<std::string> files;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        try {
+            if(arg == "-b") {
+                binary = true;
+            } else if(arg == "-f" && i + 1 < argc) {
+                from = std::stoul(argv[++i], nullptr, 16);
+            } else if(arg == "-t" && i + 1 < argc) {
+                to = std::stoul(argv[++i], nullptr, 16);
+            } else if(arg[0] == '-') {
+                usage();
+                return 1;
+            } else {
+                files.push_back(arg);
+            }
+        } catch(std::logic_error const &e) {
+            std::cerr << "Could not parse address: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if(files.empty() || files.size() > 2) {
+        usage();
+        return 1;
+    }
+
+    FILE *input = fopen(files[0].c_str(), "rb");
+    if(!input) {
+        std::cerr << "Could not read " << files[0] << std::endl;
+        return 1;
+    }
+
+    TraceHeader header;
+    if(fread(&header, sizeof(header), 1, input) != 1
+       || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+       || header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        std::cerr << files[0] << " is not a trace file" << std::endl;
+        return 1;
+    }
+
+    FILE *output = (files.size() == 2) ? fopen(files[1].c_str(), "wb") : stdout;
+    if(!output) {
+        std::cerr << "Could not open " << files[1] << " for writing" << std::endl;
+        return 1;
+    }
+
+    if(binary) fwrite(&header, sizeof(header), 1, output);
+
+    std::vector<TraceRecord> records(RECORDS_PER_READ);
+    std::vector<char> text(RECORDS_PER_READ * (DISASM_INSTRUCTION_MAX + 48));
+    uint64_t total = 0, kept = 0, expected_seq = 0, gaps = 0;
+    size_t count;
+
+    while((count = fread(records.data(), sizeof(TraceRecord), records.size(), input)) > 0) {
+        size_t out = 0;
+        char *p = text.data();
+
+        for(size_t i = 0; i < count; i++) {
+            const TraceRecord &r = records[i];
+
+            if(r.seq != expected_seq) gaps += r.seq - expected_seq;
+            expected_seq = r.seq + 1;
+
+            if(r.pc < from || r.pc > to) continue;
+
+            if(binary) {
+                records[out++] = r;
+            } else {
+                p += sprintf(p, "%10llu  %04X  %04X  %04X  ",
+                             (unsigned long long)r.seq, r.pc, r.ir, r.flags);
+                p += format_instruction(r.ir, r.ext, p);
+                *p++ = '\n';
+                out++;
+            }
+        }
+
+        if(binary) {
+            fwrite(records.data(), sizeof(TraceRecord), out, output);
+        } else {
+            fwrite(text.data(), 1, p - text.data(), output);
+        }
+
+        total += count;
+        kept += out;
+    }
+
+    fclose(input);
+    if(output != stdout) fclose(output);
+
+    std::cerr << "Read " << total << " records, kept " << kept;
+    if(gaps) std::cerr << ", " << gaps << " missing from the sequence (dropped or filtered out)";
+    std::cerr << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef DEVICE_H_
+#define DEVICE_H_
+
+#include <cstdint>
+
+class CPU;
+
+// A peripheral on the CPU's I/O port bus (IN / OUT instructions)
+class Device {
+public:
+    virtual ~Device() {}
+
+    // port is relative to the base the device was attached at
+    virtual uint16_t read(const uint16_t port) = 0;
+    virtual void write(const uint16_t port, const uint16_t value) = 0;
+
+    // called by the CPU between instruction batches, to make progress
+    virtual void tick() {}
+
+    // called before a guest data access inside the range the device asked
+    // the CPU to watch with CPU::set_snoop()
+    virtual void snoop(const uint16_t /* address */) {}
+};
+
+#endif // DEVICE_H_
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#include "cpu.h"
+#include "dma.h"
+
+bool DmaController::open_source_file(const std::string &filename) {
+    auto file = std::make_shared<std::ifstream>(filename, std::ios::in | std::ios::binary);
+    if(file->fail()) return false;
+
+    source = [file](uint16_t *buffer, size_t count) {
+        file->read((char *)buffer, count * sizeof(uint16_t));
+        return (size_t)file->gcount() / sizeof(uint16_t);
+    };
+    return true;
+}
+
+uint16_t DmaController::read(const uint16_t port) {
+    switch(port) {
+        case DMA_PORT_SRC:   return src;
+        case DMA_PORT_DST:   return dst;
+        case DMA_PORT_LEN:   return len;
+        case DMA_PORT_MODE:  return mode;
+        case DMA_PORT_CTRL:  return status;
+        case DMA_PORT_COUNT: return done;
+        default:             return 0xFFFF;
+    }
+}
+
+void DmaController::write(const uint16_t port, const uint16_t value) {
+    if(busy()) return;      // registers are locked during a transfer
+
+    switch(port) {
+        case DMA_PORT_SRC:  src = value; break;
+        case DMA_PORT_DST:  dst = value; break;
+        case DMA_PORT_LEN:  len = value; break;
+        case DMA_PORT_MODE: mode = value; break;
+        case DMA_PORT_CTRL: if(value & DMA_CTRL_START) start(); break;
+        default:            break;
+    }
+}
+
+void DmaController::start() {
+    const uint32_t mem_size = cpu.memory_size();
+
+    done = 0;
+
+    if((uint32_t)dst + len > mem_size
+       || (mode == DMA_MODE_MEMORY && (uint32_t)src + len > mem_size)
+       || (mode == DMA_MODE_HOST && !source)
+       || mode > DMA_MODE_HOST) {
+        finish(DMA_STATUS_ERROR);
+        return;
+    }
+
+    status = DMA_STATUS_BUSY;
+    if(len == 0) {
+        finish(DMA_STATUS_DONE);
+    } else {
+        watch_pending();
+    }
+}
+
+void DmaController::transfer(uint32_t words) {
+    words = std::min<uint32_t>(words, len - done);
+
+    uint16_t *mem = cpu.memory();
+    uint16_t *to = mem + dst + done;
+
+    if(mode == DMA_MODE_MEMORY) {
+        const uint16_t *from = mem + src + done;
+
+        // The controller copies upwards one word at a time, chunk after chunk:
+        // an overlapping copy behaves the same however it is chunked
+        if(to > from && to < from + (len - done)) {
+            for(uint32_t i = 0; i < words; i++) to[i] = from[i];
+        } else {
+            memmove(to, from, words * sizeof(uint16_t));
+        }
+    } else {
+        const size_t got = source(to, words);
+        if(got < words) {
+            done += got;
+            finish(DMA_STATUS_DONE | DMA_STATUS_ERROR);
+            return;
+        }
+    }
+
+    done += words;
+
+    if(done == len) {
+        finish(DMA_STATUS_DONE);
+    } else {
+        watch_pending();
+    }
+}
+
+void DmaController::finish(uint16_t new_status) {
+    status = new_status;
+    cpu.set_snoop(nullptr, {});
+}
+
+// Ask the CPU to tell us about guest accesses to what is left to transfer:
+// the rest of the destination and, for a memory copy, of the source
+void DmaController::watch_pending() {
+    const SnoopRange rest_of_dst = {(uint16_t)(dst + done), (uint32_t)(len - done)};
+
+    if(mode == DMA_MODE_MEMORY) {
+        cpu.set_snoop(this, {rest_of_dst, {(uint16_t)(src + done), (uint32_t)(len - done)}});
+    } else {
+        cpu.set_snoop(this, {rest_of_dst});
+    }
+}
+
+void DmaController::tick() {
+    if(busy()) transfer(chunk_words);
+}
+
+void DmaController::snoop(const uint16_t) {
+    if(busy()) transfer(len - done);
+}
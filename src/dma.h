@@ -0,0 +1,70 @@
+#ifndef DMA_H_
+#define DMA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "device.h"
+
+// DMA controller ports, relative to its base port
+
+#define DMA_PORT_SRC     0     // source address (memory to memory)
+#define DMA_PORT_DST     1     // destination address
+#define DMA_PORT_LEN     2     // length in words
+#define DMA_PORT_MODE    3     // DMA_MODE_*
+#define DMA_PORT_CTRL    4     // write DMA_CTRL_START to start; reads DMA_STATUS_*
+#define DMA_PORT_COUNT   5     // words transferred so far (read only)
+#define DMA_PORTS        6
+
+#define DMA_MODE_MEMORY  0     // copy LEN words from SRC to DST
+#define DMA_MODE_HOST    1     // read LEN words from the host source into DST
+
+#define DMA_CTRL_START   (1u << 0)
+
+#define DMA_STATUS_BUSY  (1u << 0)
+#define DMA_STATUS_DONE  (1u << 1)
+#define DMA_STATUS_ERROR (1u << 2)     // bad range, no host source, or it ran dry
+
+// Host source for DMA_MODE_HOST: fills up to count words, returns how many it did
+typedef std::function<size_t(uint16_t *buffer, size_t count)> DmaSource;
+
+// Block transfers into guest memory that overlap with execution: each time
+// the CPU ticks its devices, the controller moves up to chunk_words words.
+//
+// Guest data accesses to memory still being transferred (the rest of the
+// destination, or of the source of a memory copy) first complete the whole
+// transfer, so the guest never sees a half-copied word or has its stores
+// overwritten by the copy.
+class DmaController : public Device {
+
+    CPU &cpu;
+    const unsigned chunk_words;
+    DmaSource source;
+
+    uint16_t src = 0, dst = 0, len = 0, mode = DMA_MODE_MEMORY;
+    uint16_t status = 0;
+    uint16_t done = 0;              // words transferred
+
+    void start();
+    void transfer(uint32_t words);
+    void finish(uint16_t new_status);
+    void watch_pending();
+
+public:
+
+    DmaController(CPU &cpu, unsigned chunk_words = 64) : cpu(cpu), chunk_words(chunk_words) {}
+
+    void set_source(DmaSource new_source) { source = std::move(new_source); }
+    bool open_source_file(const std::string &filename);
+
+    uint16_t read(const uint16_t port) override;
+    void write(const uint16_t port, const uint16_t value) override;
+    void tick() override;
+    void snoop(const uint16_t address) override;
+
+    bool busy() const { return status & DMA_STATUS_BUSY; }
+};
+
+#endif // DMA_H_
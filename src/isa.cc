@@ -0,0 +1,160 @@
+#include "isa.h"
+
+static constexpr std::array<Opcode, 256> make_opcode_table() {
+    std::array<Opcode, 256> table{};     // everything else is illegal
+
+    table[0x00] = {"LOAD",  OPERANDS_REG_IND,    1, FLOW_NEXT};
+    table[0x01] = {"LOAD",  OPERANDS_REG_IMM4,   1, FLOW_NEXT};
+    table[0x02] = {"LOAD",  OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x03] = {"LOAD",  OPERANDS_REG_IMM16,  2, FLOW_NEXT};
+    table[0x10] = {"STORE", OPERANDS_IND_REG,    1, FLOW_NEXT};
+    table[0x11] = {"STORE", OPERANDS_IND_IMM4,   1, FLOW_NEXT};
+    table[0x20] = {"ADD",   OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x21] = {"ADC",   OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x30] = {"NOT",   OPERANDS_REG_LOW,    1, FLOW_NEXT};
+    table[0x31] = {"AND",   OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x32] = {"OR",    OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x33] = {"XOR",   OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x40] = {"CMP",   OPERANDS_REG_REG,    1, FLOW_NEXT};
+    table[0x41] = {"CMP",   OPERANDS_REG_IMM4,   1, FLOW_NEXT};
+    table[0x42] = {"CMP",   OPERANDS_REG_IMM16,  2, FLOW_NEXT};
+    table[0x50] = {"JMPR",  OPERANDS_REL8,       1, FLOW_JUMP};
+    table[0x51] = {"JMP",   OPERANDS_COND_ABS16, 2, FLOW_JUMP};
+    table[0x60] = {"RDCTR", OPERANDS_REG_IMM4,   1, FLOW_NEXT};
+    table[0x70] = {"TRAP",  OPERANDS_IMM8,       1, FLOW_NEXT};
+    table[0x80] = {"OUT",   OPERANDS_IND_REG,    1, FLOW_NEXT};
+    table[0x81] = {"IN",    OPERANDS_REG_IND,    1, FLOW_NEXT};
+    table[0xF8] = {"HALT",  OPERANDS_NONE,       1, FLOW_STOP};
+    table[0xFF] = {"NOP",   OPERANDS_NONE,       1, FLOW_NEXT};
+
+    return table;
+}
+
+const std::array<Opcode, 256> opcode_table = make_opcode_table();
+
+const char *const condition_suffix[16] = {
+    "",    ".EQ",  ".B",  ".BE", ".L",  ".LE", ".N",  ".V",
+    "UNDEFINED",  ".NEQ", ".AE", ".A",  ".G",  ".GE", ".P",  ".NV",
+};
+
+// Small formatting helpers: each appends to p and returns the new end.
+// Hand-rolled so that bulk disassembly and tracing stay clear of iostreams.
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static inline char *put_str(char *p, const char *s) {
+    while(*s) *p++ = *s++;
+    return p;
+}
+
+static inline char *put_dec(char *p, unsigned val) {
+    if(val >= 10) *p++ = '0' + val / 10;
+    *p++ = '0' + val % 10;
+    return p;
+}
+
+static inline char *put_hex(char *p, uint16_t val) {
+    int shift = 12;
+    while(shift > 0 && !(val >> shift)) shift -= 4;   // no leading zeroes
+    for(; shift >= 0; shift -= 4) *p++ = hex_digits[(val >> shift) & 0xF];
+    return p;
+}
+
+static inline char *put_hex4(char *p, uint16_t val) {
+    p[0] = hex_digits[(val >> 12) & 0xF];
+    p[1] = hex_digits[(val >>  8) & 0xF];
+    p[2] = hex_digits[(val >>  4) & 0xF];
+    p[3] = hex_digits[val & 0xF];
+    return p + 4;
+}
+
+static inline char *put_reg(char *p, unsigned reg) {
+    *p++ = 'r';
+    return put_dec(p, reg);
+}
+
+size_t format_instruction(uint16_t ir, uint16_t ext, char *out) {
+    const Opcode &op = decode(ir);
+    const unsigned high = (ir >> 4) & 0x000F;
+    const unsigned low = ir & 0x000F;
+    char *p = out;
+
+    if(op.operands == OPERANDS_ILLEGAL) {
+        p = put_str(p, "???");
+        *p = '\0';
+        return p - out;
+    }
+
+    p = put_str(p, op.mnemonic);
+
+    switch(op.operands) {
+        case OPERANDS_REG_IND:
+            p = put_reg(put_str(p, " "), high);
+            p = put_str(put_reg(put_str(p, ", ("), low), ")");
+            break;
+        case OPERANDS_REG_IMM4:
+            p = put_reg(put_str(p, " "), high);
+            p = put_dec(put_str(p, ", #"), low);
+            break;
+        case OPERANDS_REG_REG:
+            p = put_reg(put_str(p, " "), high);
+            p = put_reg(put_str(p, ", "), low);
+            break;
+        case OPERANDS_REG_IMM16:
+            p = put_reg(put_str(p, " "), high);
+            p = put_hex(put_str(p, ", #$"), ext);
+            break;
+        case OPERANDS_IND_REG:
+            p = put_reg(put_str(p, " ("), high);
+            p = put_reg(put_str(p, "), "), low);
+            break;
+        case OPERANDS_IND_IMM4:
+            p = put_reg(put_str(p, " ("), low);
+            p = put_dec(put_str(p, "), #"), high);
+            break;
+        case OPERANDS_REG_LOW:
+            p = put_reg(put_str(p, " "), low);
+            break;
+        case OPERANDS_REL8:
+        case OPERANDS_IMM8:
+            p = put_hex(put_str(p, " #$"), ir & 0x00FF);
+            break;
+        case OPERANDS_COND_ABS16:
+            p = put_str(p, condition_suffix[low]);
+            p = put_hex(put_str(p, " #$"), ext);
+            break;
+        default:
+            break;
+    }
+
+    *p = '\0';
+    return p - out;
+}
+
+size_t disassemble_range(const uint16_t *mem, uint32_t mem_size,
+                         uint32_t start, uint32_t end,
+                         char *out, size_t out_size, uint32_t *next) {
+    if(end > mem_size) end = mem_size;
+
+    char *p = out;
+    uint32_t address = start;
+
+    while(address < end && (size_t)(p - out) + DISASM_LINE_MAX <= out_size) {
+        const uint16_t ir = mem[address];
+        const uint8_t words = decode(ir).words;
+        // An immediate word past the end of memory reads as zero
+        const uint16_t ext = (address + 1 < mem_size) ? mem[address + 1] : 0;
+
+        p = put_str(put_hex4(p, address), "  ");
+        p = put_hex4(p, ir);
+        p = (words == 2) ? put_hex4(put_str(p, " "), ext) : put_str(p, "     ");
+        p = put_str(p, "  ");
+        p += format_instruction(ir, ext, p);
+        *p++ = '\n';
+
+        address += words ? words : 1;
+    }
+
+    if(next) *next = address;
+    return p - out;
+}
@@ -0,0 +1,67 @@
+#ifndef ISA_H_
+#define ISA_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Operand layouts of the instruction set. H and L are the high and low
+// nibbles of the instruction parameter byte, W is the word following the
+// instruction.
+
+enum Operands : uint8_t {
+    OPERANDS_ILLEGAL = 0,   // not an instruction: the CPU halts
+    OPERANDS_NONE,          // HALT
+    OPERANDS_REG_IND,       // rH, (rL)
+    OPERANDS_REG_IMM4,      // rH, #L
+    OPERANDS_REG_REG,       // rH, rL
+    OPERANDS_REG_IMM16,     // rH, #$W
+    OPERANDS_IND_REG,       // (rH), rL
+    OPERANDS_IND_IMM4,      // (rL), #H
+    OPERANDS_REG_LOW,       // rL
+    OPERANDS_REL8,          // #$param, relative
+    OPERANDS_IMM8,          // #$param
+    OPERANDS_COND_ABS16,    // .cc #$W
+};
+
+// Where execution continues after an instruction
+enum Flow : uint8_t {
+    FLOW_STOP = 0,          // the CPU halts (HALT, illegal opcodes)
+    FLOW_NEXT,              // falls through to the next instruction
+    FLOW_JUMP,              // may transfer control elsewhere
+};
+
+struct Opcode {
+    const char *mnemonic;
+    Operands operands;
+    uint8_t words;          // instruction length, including immediate words
+    Flow flow;
+};
+
+// Indexed by the high byte of the instruction word
+extern const std::array<Opcode, 256> opcode_table;
+
+// Mnemonic suffix of each JMP condition code, e.g. ".EQ"
+extern const char *const condition_suffix[16];
+
+inline const Opcode &decode(uint16_t ir) { return opcode_table[ir >> 8]; }
+
+// Longest instruction text, including the terminating NUL
+#define DISASM_INSTRUCTION_MAX 24
+
+// Longest line written by disassemble_range, including the newline
+#define DISASM_LINE_MAX (DISASM_INSTRUCTION_MAX + 18)
+
+// Writes the text of instruction ir (ext is the following word, only used by
+// two-word instructions) into out, which must hold DISASM_INSTRUCTION_MAX
+// bytes. Returns the number of characters written, excluding the NUL.
+size_t format_instruction(uint16_t ir, uint16_t ext, char *out);
+
+// Disassembles mem[start..end) as "ADDR  WORD [WORD]  TEXT" lines into out.
+// Stops early when out cannot hold another line; *next receives the address
+// to resume from. Returns the number of bytes written (no NUL is added).
+size_t disassemble_range(const uint16_t *mem, uint32_t mem_size,
+                         uint32_t start, uint32_t end,
+                         char *out, size_t out_size, uint32_t *next);
+
+#endif // ISA_H_
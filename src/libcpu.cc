@@ -0,0 +1,113 @@
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "cpu.h"
+#include "device.h"
+#include "libcpu.h"
+
+static_assert(LIBCPU_COUNTERS == COUNTERS, "C API counter block out of step with the CPU");
+static_assert(LIBCPU_FAULT_NONE == FAULT_NONE && LIBCPU_FAULT_ILLEGAL_OPCODE == FAULT_ILLEGAL_OPCODE
+              && LIBCPU_FAULT_UNHANDLED_TRAP == FAULT_UNHANDLED_TRAP, "C API fault codes out of step with the CPU");
+
+// Device forwarding IN / OUT to host callbacks
+class CallbackDevice : public Device {
+
+    libcpu_port_read on_read;
+    libcpu_port_write on_write;
+    void *user;
+
+public:
+
+    CallbackDevice(libcpu_port_read read, libcpu_port_write write, void *user)
+        : on_read(read), on_write(write), user(user) {}
+
+    uint16_t read(const uint16_t port) override { return on_read ? on_read(user, port) : 0xFFFF; }
+    void write(const uint16_t port, const uint16_t value) override { if(on_write) on_write(user, port, value); }
+};
+
+struct libcpu {
+    CPU cpu;
+    std::vector<std::unique_ptr<CallbackDevice>> devices;
+
+    libcpu(const uint32_t mem_words) : cpu(mem_words) {}
+};
+
+static bool in_memory(const libcpu *cpu, const uint32_t start, const uint32_t count) {
+    return start <= cpu->cpu.memory_size() && count <= cpu->cpu.memory_size() - start;
+}
+
+uint32_t cpu_api_version(void) {
+    return LIBCPU_API_VERSION;
+}
+
+libcpu *cpu_create(uint32_t mem_words) {
+    if(mem_words != LIBCPU_MEM_WORDS) return nullptr;
+
+    libcpu *cpu = new(std::nothrow) libcpu(mem_words);
+    if(!cpu) return nullptr;
+
+    memset(cpu->cpu.memory(), 0, mem_words * sizeof(uint16_t));
+    cpu->cpu.reset();
+    return cpu;
+}
+
+void cpu_destroy(libcpu *cpu) {
+    delete cpu;
+}
+
+void cpu_reset(libcpu *cpu) {
+    cpu->cpu.reset();
+}
+
+int cpu_mem_write(libcpu *cpu, uint32_t start, const uint16_t *words, uint32_t count) {
+    if(!in_memory(cpu, start, count)) return LIBCPU_ERR_RANGE;
+    memcpy(cpu->cpu.memory() + start, words, count * sizeof(uint16_t));
+    return LIBCPU_OK;
+}
+
+int cpu_mem_read(const libcpu *cpu, uint32_t start, uint16_t *words, uint32_t count) {
+    if(!in_memory(cpu, start, count)) return LIBCPU_ERR_RANGE;
+    memcpy(words, cpu->cpu.memory() + start, count * sizeof(uint16_t));
+    return LIBCPU_OK;
+}
+
+uint64_t cpu_run(libcpu *cpu, uint64_t budget) {
+    return cpu->cpu.run(budget);
+}
+
+int cpu_halted(const libcpu *cpu) {
+    return cpu->cpu.halted();
+}
+
+int cpu_fault(const libcpu *cpu) {
+    return cpu->cpu.halted() ? cpu->cpu.fault() : LIBCPU_FAULT_NONE;
+}
+
+void cpu_get_regs(const libcpu *cpu, libcpu_regs *regs) {
+    for(unsigned i = 0; i < 16; i++) regs->r[i] = cpu->cpu.getreg(i);
+    regs->pc = cpu->cpu.getPC();
+    regs->flags = cpu->cpu.flags();
+}
+
+void cpu_set_regs(libcpu *cpu, const libcpu_regs *regs) {
+    for(unsigned i = 0; i < 16; i++) cpu->cpu.setreg(i, regs->r[i]);
+    cpu->cpu.setPC(regs->pc);
+    cpu->cpu.setflags(regs->flags);
+}
+
+void cpu_get_counters(const libcpu *cpu, uint64_t counters[LIBCPU_COUNTERS]) {
+    for(unsigned i = 0; i < LIBCPU_COUNTERS; i++) counters[i] = cpu->cpu.counter(i);
+}
+
+int cpu_attach_ports(libcpu *cpu, uint16_t base, uint16_t count,
+                     libcpu_port_read read, libcpu_port_write write, void *user) {
+    try {
+        cpu->devices.push_back(std::make_unique<CallbackDevice>(read, write, user));
+        cpu->cpu.attach_device(cpu->devices.back().get(), base, count);
+    } catch(std::bad_alloc const &e) {
+        return LIBCPU_ERR_MEMORY;
+    }
+    return LIBCPU_OK;
+}
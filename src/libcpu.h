@@ -0,0 +1,81 @@
+#ifndef LIBCPU_H_
+#define LIBCPU_H_
+
+/*
+ * C API for embedding the emulator (build/libcpu.a, build/libcpu.so).
+ *
+ * Calls work on whole ranges, register blocks and instruction budgets, so a
+ * host can load a program, run a million instructions and read back its
+ * results in a handful of calls. Structures only ever grow at the end, and
+ * cpu_api_version() changes when they do.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBCPU_API_VERSION  1
+
+#define LIBCPU_OK           0
+#define LIBCPU_ERR_RANGE   -1      /* address range outside guest memory */
+#define LIBCPU_ERR_MEMORY  -2      /* host out of memory */
+
+#define LIBCPU_COUNTERS     4      /* retired, taken jumps, loads, stores */
+
+/* Why the CPU halted, from cpu_fault() */
+#define LIBCPU_FAULT_NONE              0    /* HALT instruction, or not halted */
+#define LIBCPU_FAULT_ILLEGAL_OPCODE    1
+#define LIBCPU_FAULT_UNHANDLED_TRAP    2
+
+/* Guest memory covers the whole 16-bit address space: the core does not
+   bounds-check the addresses guest code loads, stores or jumps to */
+#define LIBCPU_MEM_WORDS    0x10000
+
+#define LIBCPU_API __attribute__((visibility("default")))
+
+typedef struct libcpu libcpu;
+
+typedef struct {
+    uint16_t r[16];
+    uint16_t pc;
+    uint16_t flags;
+} libcpu_regs;
+
+/* I/O callbacks for IN / OUT on the ports attached with cpu_attach_ports();
+   port is relative to the base */
+typedef uint16_t (*libcpu_port_read)(void *user, uint16_t port);
+typedef void (*libcpu_port_write)(void *user, uint16_t port, uint16_t value);
+
+LIBCPU_API uint32_t cpu_api_version(void);
+
+/* mem_words must be LIBCPU_MEM_WORDS; memory starts zeroed and the CPU
+   reset. Returns NULL on failure. */
+LIBCPU_API libcpu *cpu_create(uint32_t mem_words);
+LIBCPU_API void cpu_destroy(libcpu *cpu);
+LIBCPU_API void cpu_reset(libcpu *cpu);
+
+/* count words from / to guest memory at start; all or nothing */
+LIBCPU_API int cpu_mem_write(libcpu *cpu, uint32_t start, const uint16_t *words, uint32_t count);
+LIBCPU_API int cpu_mem_read(const libcpu *cpu, uint32_t start, uint16_t *words, uint32_t count);
+
+/* Runs up to budget instructions, stopping early on HALT. Returns how many ran. */
+LIBCPU_API uint64_t cpu_run(libcpu *cpu, uint64_t budget);
+LIBCPU_API int cpu_halted(const libcpu *cpu);
+/* LIBCPU_FAULT_*: the library never prints, faults are only reported here */
+LIBCPU_API int cpu_fault(const libcpu *cpu);
+
+LIBCPU_API void cpu_get_regs(const libcpu *cpu, libcpu_regs *regs);
+LIBCPU_API void cpu_set_regs(libcpu *cpu, const libcpu_regs *regs);
+LIBCPU_API void cpu_get_counters(const libcpu *cpu, uint64_t counters[LIBCPU_COUNTERS]);
+
+/* Either callback may be NULL: reads then return FFFF, writes are ignored */
+LIBCPU_API int cpu_attach_ports(libcpu *cpu, uint16_t base, uint16_t count,
+                                libcpu_port_read read, libcpu_port_write write, void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBCPU_H_ */
@@ -1,36 +1,248 @@
+#include <csignal>
 #include <iostream>
 #include <fstream>
 #include <regex>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 namespace fs = std::filesystem;
 
+#include "coverage.h"
 #include "cpu.h"
+#include "dma.h"
+#include "sampler.h"
 #include "tools.h"
+#include "trace.h"
+#include "uarch.h"
 
 #define MEM_SIZE 4096
+#define HEADLESS_MEM_SIZE 0x10000   // any image runs: guest addresses are not bounds-checked
+#define DMA_BASE_PORT 0x0010
+
+// Instructions run between two checks for Ctrl-C or the instruction limit
+#define RUN_BATCH_INSTRUCTIONS 100000
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int) {
+    interrupted = 1;
+}
+
+// Command line options
+struct Options {
+    bool headless = false;
+    std::string coverage_filename;
+    uint64_t max_instructions = 0;      // 0: no limit
+    uint16_t location = 0x100;
+    std::string dma_source;
+    bool analyze = false;
+    std::string caches = UARCH_DEFAULT_CACHES;
+    std::string predictor = UARCH_DEFAULT_PREDICTOR;
+    bool sample = false;
+};
+
+static void usage() {
+    std::cout << "Usage: cpu [-D file] [-A] [-C caches] [-B predictor] [-S] [image [location]]" << std::endl
+              << "       cpu -H [-c coverage.info] [-n max] [-l location] [-D file] [-A] [-C caches] [-B predictor] [-S] image..." << std::endl
+              << "    -H           headless: run each image until HALT, without the monitor" << std::endl
+              << "    -c file      write lcov coverage of the .cpu images to file" << std::endl
+              << "    -n max       stop an image after max instructions (counts as a failure)" << std::endl
+              << "    -l location  load address of the images, in hex (0100 if not specified)" << std::endl
+              << "    -D file      host file read by DMA transfers in host mode" << std::endl
+              << "    -A           microarchitecture analysis: caches, branch prediction, memory heat map" << std::endl
+              << "    -C caches    cache levels name:size:ways:line,... in words, implies -A" << std::endl
+              << "                 (default " UARCH_DEFAULT_CACHES ")" << std::endl
+              << "    -B predictor bimodal:bits or gshare:bits, implies -A (default " UARCH_DEFAULT_PREDICTOR ")" << std::endl
+              << "    -S           sample running guests: live MIPS, and the hottest PCs when they stop" << std::endl;
+}
+
+// Attaches a DMA controller at DMA_BASE_PORT. Returns false if the host
+// source file cannot be opened.
+static bool attach_dma(CPU &cpu, DmaController &dma, const Options &options) {
+    cpu.attach_device(&dma, DMA_BASE_PORT, DMA_PORTS);
+
+    if(!options.dma_source.empty() && !dma.open_source_file(options.dma_source)) {
+        std::cerr << "Could not read " << options.dma_source << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Says why the CPU halted, if it was not a HALT instruction
+static void report_fault(const CPU &cpu) {
+    if(!cpu.halted()) return;
+
+    if(cpu.fault() == FAULT_ILLEGAL_OPCODE) std::cout << "Illegal opcode: CPU halted" << std::endl;
+    if(cpu.fault() == FAULT_UNHANDLED_TRAP) std::cout << "Unhandled trap: CPU halted" << std::endl;
+}
+
+// Runs each image in a fresh CPU until it halts. Returns the exit status:
+// non-zero if any image could not be loaded or did not halt.
+static int run_headless(const std::vector<std::string> &images, const Options &options)
+{
+    const uint16_t location = options.location;
+    const uint64_t max_instructions = options.max_instructions;
+    std::ofstream report;
+    int status = 0;
+
+    if(!options.coverage_filename.empty()) {
+        report.open(options.coverage_filename);
+        if(!report) {
+            std::cerr << "Could not open " << options.coverage_filename << " for writing" << std::endl;
+            return 1;
+        }
+    }
+
+    for(const auto &image : images) {
+        CPU cpu(HEADLESS_MEM_SIZE);
+        DmaController dma(cpu);
+        Coverage coverage(HEADLESS_MEM_SIZE);
+        Uarch uarch;
+        Sampler sampler(cpu, std::cout);
+        uint16_t buffer[MEM_SIZE];
+
+        if(!attach_dma(cpu, dma, options)) return 1;
+        if(options.analyze) {
+            uarch.configure(options.caches, options.predictor);
+            cpu.set_uarch(&uarch);
+        }
+
+        uint16_t filesize = load_file(image, buffer, MEM_SIZE);
+        if(!filesize) {
+            std::cerr << "Could not load " << image << std::endl;
+            status = 1;
+            continue;
+        }
+
+        cpu.loadmem(buffer, filesize, location);
+        cpu.reset();
+        if(report.is_open()) cpu.set_coverage(&coverage);
+
+        uint64_t executed = 0;
+        if(options.sample) sampler.start();
+        while(!cpu.halted() && (!max_instructions || executed < max_instructions)) {
+            uint64_t batch = RUN_BATCH_INSTRUCTIONS;
+            if(max_instructions) batch = std::min(batch, max_instructions - executed);
+            executed += cpu.run(batch);
+        }
+        sampler.stop();
+        report_fault(cpu);
+
+        std::cout << image << ": " << (cpu.halted() ? "halted" : "stopped")
+                  << " at PC=" << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
+                  << cpu.getPC() << std::dec << " after " << executed << " instructions" << std::endl;
+        if(!cpu.halted()) status = 1;
+
+        if(options.analyze) uarch.report(std::cout);
+
+        if(report.is_open()) {
+            std::vector<ListingLine> lines = load_listing_lines(image, location);
+            if(lines.empty()) {
+                std::cerr << "No .cpu listing for " << image << ": not in coverage report" << std::endl;
+            } else {
+                coverage.write_lcov(report, fs::absolute(image).string(), lines, cpu.memory());
+            }
+        }
+    }
+
+    return status;
+}
 
 
 int main(int argc, char *argv[])
 {
+    Options options;
+    std::vector<std::string> args;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        try {
+            if(arg == "-H") {
+                options.headless = true;
+            } else if(arg == "-c" && i + 1 < argc) {
+                options.coverage_filename = argv[++i];
+            } else if(arg == "-n" && i + 1 < argc) {
+                options.max_instructions = std::stoull(argv[++i]);
+            } else if(arg == "-l" && i + 1 < argc) {
+                options.location = std::stoi(argv[++i], nullptr, 16);
+            } else if(arg == "-D" && i + 1 < argc) {
+                options.dma_source = argv[++i];
+            } else if(arg == "-A") {
+                options.analyze = true;
+            } else if(arg == "-C" && i + 1 < argc) {
+                options.caches = argv[++i];
+                options.analyze = true;
+            } else if(arg == "-B" && i + 1 < argc) {
+                options.predictor = argv[++i];
+                options.analyze = true;
+            } else if(arg == "-S") {
+                options.sample = true;
+            } else if(arg[0] == '-') {
+                usage();
+                return 1;
+            } else {
+                args.push_back(arg);
+            }
+        } catch(std::logic_error const &e) {
+            std::cerr << "Could not parse " << arg << " argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if(options.analyze) {
+        std::string error = Uarch().configure(options.caches, options.predictor);
+        if(!error.empty()) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    if(options.headless) {
+        if(args.empty()) {
+            usage();
+            return 1;
+        }
+        return run_headless(args, options);
+    }
+
     CPU cpu(MEM_SIZE);
+    DmaController dma(cpu);
+    Uarch uarch;
+    uint16_t location = options.location;
+
+    if(!attach_dma(cpu, dma, options)) return 1;
+    if(options.analyze) {
+        uarch.configure(options.caches, options.predictor);
+        cpu.set_uarch(&uarch);
+    }
+
+    Sampler sampler(cpu, std::cout);
+    bool sample = options.sample;
+
+    // Ctrl-C stops "g" and returns to the prompt
+    struct sigaction action = {};
+    action.sa_handler = on_interrupt;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
 
     std::cout << "Custom 16-bit ISA CPU Emulator" << std::endl;
     std::cout << "(c) Alice Wyan, 2024" << std::endl << std::endl;
 
     // Passing a parameter with a RAM image to run
-    if(argc > 1) {
+    if(!args.empty()) {
         uint16_t buffer[MEM_SIZE];
-        uint16_t location = 0x100;
         uint16_t filesize;
 
-        if(argc > 2) location = std::stoi(argv[2], nullptr, 16);
+        if(args.size() > 1) location = std::stoi(args[1], nullptr, 16);
         // load_file_into_memory(cpu, argv[1], location);
-        filesize = load_file(argv[1], buffer, MEM_SIZE);
+        filesize = load_file(args[0], buffer, MEM_SIZE);
         if(filesize) {
             cpu.loadmem(buffer, filesize, location);
             std::cout << "Loaded " << filesize << " bytes"
-                      << " from " << argv[1] << " at memory address "
+                      << " from " << args[0] << " at memory address "
                       << std::hex << std::setw(4) << std::setfill('0') << std::uppercase
                       << location << std::endl;
         } else {
@@ -40,6 +252,8 @@ int main(int argc, char *argv[])
 
     cpu.reset();
 
+    std::unique_ptr<TraceSink> trace_sink;
+
     while(1) {
         std::string cmd;
 
@@ -67,8 +281,14 @@ int main(int argc, char *argv[])
             }
             else if(m[1] == "d") { std::cout << "Not implemented yet" << std::endl; }
             else if(m[1] == "g") {
-                while(!cpu.halted())
-                    cpu.run_once();
+                interrupted = 0;
+                if(sample) sampler.start();
+                const bool was_halted = cpu.halted();
+                while(!cpu.halted() && !interrupted)
+                    cpu.run(RUN_BATCH_INSTRUCTIONS);
+                sampler.stop();
+                if(!was_halted) report_fault(cpu);
+                if(interrupted) std::cout << std::endl << "Interrupted" << std::endl;
             }
             else if(m[1] == "l") {
                 std::smatch f;
@@ -126,10 +346,24 @@ int main(int argc, char *argv[])
                 }
                 cpu.setPC(location);
             }
-            else if(m[1] == "n") { cpu.run_once(); }
+            else if(m[1] == "n") {
+                const bool was_halted = cpu.halted();
+                cpu.run_once();
+                if(!was_halted) report_fault(cpu);
+            }
+            else if(m[1] == "a") {
+                if(!options.analyze) {
+                    std::cout << "Analysis is off: start the emulator with -A" << std::endl;
+                } else if(m[2] == "clear") {
+                    uarch.clear();
+                } else {
+                    uarch.report(std::cout);
+                }
+            }
             else if(m[1] == "r") {
                 cpu.dump_flags();
                 cpu.dump_registers();
+                cpu.dump_counters();
             }
             else if(m[1] == "x") {
                 std::string arg(m[2]);
@@ -151,24 +385,96 @@ int main(int argc, char *argv[])
                     std::cout << std::endl;
                 }
             }
+            else if(m[1] == "u") {
+                std::string args(m[2]);
+                std::smatch a;
+                uint32_t start = cpu.getPC();
+                uint32_t end;
+
+                if(!std::regex_match(args, a, std::regex("^\\s*([0-9A-Fa-f]+)?(?:\\s+([0-9A-Fa-f]+))?\\s*$"))) {
+                    std::cerr << "Could not parse range: " << args << std::endl;
+                    continue;
+                }
+                try {
+                    if(a[1].matched) start = std::stoul(a[1], nullptr, 16);
+                    end = a[2].matched ? std::stoul(a[2], nullptr, 16) + 1 : std::min(start + 0x20, 0x10000u);
+                } catch (std::out_of_range const &e) {
+                    start = end = 0x10001;
+                }
+                if(start > 0xFFFF || end > 0x10000) {
+                    std::cerr << "Range out of range: " << args << std::endl
+                              << "Usage: u [m [e]] with m and e at most FFFF" << std::endl;
+                    continue;
+                }
+
+                static char text[65536];
+                while(start < end) {
+                    uint32_t next;
+                    size_t len = cpu.disassemble(start, end, text, sizeof(text), &next);
+                    if(next == start) break;        // past the end of memory
+                    std::cout.write(text, len);
+                    start = next;
+                }
+                std::cout.flush();
+            }
             else if(m[1] == "R") {
                 cpu.reset();
                 std::cout << "CPU reset" << std::endl;
             }
+            else if(m[1] == "t") {
+                std::smatch f;
+                std::string args(m[2]);
+
+                if(trace_sink) {
+                    cpu.set_trace_sink(nullptr);
+                    trace_sink->close();    // waits for the writer to drain
+                    std::cout << std::dec << "Wrote " << trace_sink->written() << " trace records, "
+                              << trace_sink->dropped() << " dropped" << std::endl;
+                    if(trace_sink->failed())
+                        std::cerr << "Could not write the whole trace: the file is incomplete" << std::endl;
+                    trace_sink.reset();
+                }
+
+                if(args.empty()) {
+                    std::cout << "Binary trace off" << std::endl;
+                } else if(std::regex_match(args, f, std::regex("^((?:\\\\[ ]|[^ ])+)(?:\\s+(block|drop))?$"))) {
+                    TracePolicy policy = (f[2] == "drop") ? TracePolicy::DROP : TracePolicy::BLOCK;
+                    std::string filename(f[1]);
+
+                    trace_sink = std::make_unique<TraceSink>(filename, policy);
+                    if(trace_sink->ok()) {
+                        cpu.set_trace_sink(trace_sink.get());
+                        std::cout << "Binary trace to " << filename << std::endl;
+                    } else {
+                        trace_sink.reset();
+                        std::cout << "Could not open " << filename << " for writing" << std::endl;
+                    }
+                } else {
+                    std::cerr << "Could not parse trace arguments: " << args << std::endl;
+                }
+            }
+            else if(m[1] == "s") {
+                sample = !sample;
+                std::cout << "Sampling " << (sample ? "on" : "off") << std::endl;
+            }
             else if(m[1] == "T") {
                 cpu.toggle_tracing();
                 std::cout << "Tracing " << (cpu.tracing() ? "on" : "off") << std::endl;
             }
             else if(m[1] == "?") {
                 std::cout <<
+                    "    a [clear] - microarchitecture analysis report (with -A), or clear its statistics\n" <<
                     "    d [m [v]] - deposit values into memory\n" <<
-                    "    g         - go (run until HALT)\n" <<
+                    "    g         - go (run until HALT, or Ctrl-C)\n" <<
                     "    l f [m]   - load file f in memory position m (0x0100 if not specified)\n" <<
                     "    n         - run next instruction\n" <<
                     "    p [m]     - deposit the value m into the PC register (0x0100 if not specified) \n" <<
                     "    q         - quit emulator\n" <<
-                    "    r         - dump CPU flags and register file\n" <<
+                    "    r         - dump CPU flags, register file and performance counters\n" <<
+                    "    s         - toggle sampling during g: live MIPS, then the hottest PCs\n" <<
+                    "    t [f [p]] - binary trace to file f, p = block or drop when behind (no f: stop)\n" <<
                     "    T         - toggle instruction tracing\n" <<
+                    "    u [m [e]] - disassemble memory from m (PC if not specified) up to e\n" <<
                     "    x [m]     - examine memory at position m (PC if not specified)\n" <<
                     "    R         - perform a CPU reset\n" <<
                     "    ?         - this help\n";
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include "isa.h"
+#include "sampler.h"
+
+void Sampler::start() {
+    if(running()) return;
+
+    std::fill(hits.begin(), hits.end(), 0);
+    samples = 0;
+    stopping = false;
+    thread = std::thread(&Sampler::loop, this);
+}
+
+void Sampler::stop() {
+    if(!running()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+
+    report_hot_pcs();
+}
+
+void Sampler::loop() {
+    using clock = std::chrono::steady_clock;
+
+    const auto period = std::chrono::microseconds(SAMPLER_PERIOD_US);
+    const auto report_period = std::chrono::milliseconds(SAMPLER_REPORT_MS);
+
+    uint64_t last_retired = cpu.progress_snapshot() >> 16;
+    auto last_report = clock::now();
+    auto next_sample = last_report + period;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!wake.wait_until(lock, next_sample, [this] { return stopping; })) {
+        const uint64_t snapshot = cpu.progress_snapshot();
+        const auto now = clock::now();
+
+        hits[(uint16_t)snapshot]++;
+        samples++;
+        next_sample += period;
+        if(next_sample < now) next_sample = now + period;      // fell behind: do not catch up
+
+        if(now - last_report >= report_period) {
+            const uint64_t retired = snapshot >> 16;
+            const std::chrono::duration<double> elapsed = now - last_report;
+            std::ostringstream line;
+
+            line << std::fixed << std::setprecision(2) << (retired - last_retired) / elapsed.count() / 1e6
+                 << " MIPS, PC=" << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
+                 << (uint16_t)snapshot << std::dec << ", " << retired << " retired" << std::endl;
+            out << line.str() << std::flush;
+
+            last_retired = retired;
+            last_report = now;
+        }
+    }
+}
+
+void Sampler::report_hot_pcs() {
+    std::vector<uint32_t> pcs;
+    for(uint32_t pc = 0; pc < hits.size(); pc++) {
+        if(hits[pc]) pcs.push_back(pc);
+    }
+    std::sort(pcs.begin(), pcs.end(), [this](uint32_t a, uint32_t b) { return hits[a] > hits[b]; });
+
+    // Formatted apart so the caller's stream keeps its own flags
+    std::ostringstream report;
+    report << "Hot PCs (" << samples << " samples):" << std::endl;
+    for(size_t i = 0; i < pcs.size() && i < SAMPLER_HOT_PCS; i++) {
+        char text[DISASM_INSTRUCTION_MAX] = "";
+        if(pcs[i] < cpu.memory_size()) cpu.disassemble(pcs[i], text);
+
+        report << "  " << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << pcs[i]
+               << std::dec << std::setfill(' ') << std::fixed << std::setprecision(1)
+               << std::setw(7) << 100.0 * hits[pcs[i]] / samples << "%  " << text << std::endl;
+    }
+    out << report.str() << std::flush;
+}
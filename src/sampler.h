@@ -0,0 +1,46 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+
+#define SAMPLER_PERIOD_US   1000    // between two samples of the PC
+#define SAMPLER_REPORT_MS   1000    // between two lines of live statistics
+#define SAMPLER_HOT_PCS     10
+
+// Samples a CPU running on another thread through its progress snapshot:
+// prints the instruction rate while it runs, and the addresses where it was
+// found most often when stopped. The CPU thread does not wait for it.
+class Sampler {
+
+    const CPU &cpu;
+    std::ostream &out;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::vector<uint64_t> hits;     // samples by PC
+    uint64_t samples = 0;
+
+    void loop();
+    void report_hot_pcs();
+
+public:
+
+    Sampler(const CPU &cpu, std::ostream &out) : cpu(cpu), out(out), hits(0x10000) {}
+    ~Sampler() { stop(); }
+
+    void start();       // starts a fresh profile
+    void stop();        // prints the hot PCs, if it was running
+    bool running() const { return thread.joinable(); }
+};
+
+#endif // SAMPLER_H_
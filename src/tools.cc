@@ -1,6 +1,8 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <regex>
 
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -24,38 +26,76 @@ uint16_t load_file_binary(const std::string filename, uint16_t *buffer, uint16_t
     return bytes_read;
 }
 
-// Returns bytes_read (after conversion) if everything went right, 0 if something went wrong
-uint16_t load_file_text(const std::string filename, uint16_t *buffer, uint16_t buffer_size)
+static inline int hex_digit(const char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool parse_listing(const char *text, const size_t size, std::vector<uint16_t> &words,
+                   std::vector<unsigned> *line_numbers)
 {
-    std::ifstream file(filename, std::ios::in);
-    if(file.fail()) return false;
+    const char *end = text + size;
+    unsigned line_number = 0;
 
-    std::string line;
-    std::smatch match;
-    uint16_t words_read = 0;
+    for(const char *line = text; line < end;) {
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        if(!eol) eol = end;
+        line_number++;
 
-    while(std::getline(file, line)) {
         // Skip comments
-        if (!line.empty() && line[0] == ';') continue;
-        if(line.size() > 2 && line.substr(0, 2) == "//") continue;
-
-        // Search for a hexadecimal constant at the beginning of the line
-        if (std::regex_search(line, match, std::regex("((?:0x)?[0-9A-Fa-f]+)"))) {
-            std::string hex_str = match[0];
-            uint16_t value = std::stoi(hex_str, nullptr, 16);
-
-            if(words_read > buffer_size) {
-                return 0;       // Signal error on overflow
-            } else {
-                buffer[words_read++] = value;
-            }
+        const bool comment = (eol - line >= 1 && line[0] == ';')
+                          || (eol - line >= 2 && line[0] == '/' && line[1] == '/');
 
-            // Process the hexadecimal value, here we just print it
-            std::cout << "Hexadecimal: " << hex_str << " -> Decimal: " << value << std::endl;
+        // The word is the first run of hex digits on the line, after an optional 0x
+        const char *p = line;
+        while(!comment && p < eol && hex_digit(*p) < 0) p++;
+
+        if(!comment && p < eol) {
+            if(p[0] == '0' && eol - p > 2 && p[1] == 'x' && hex_digit(p[2]) >= 0) p += 2;
+
+            uint64_t value = 0;
+            for(int digit; p < eol && (digit = hex_digit(*p)) >= 0; p++) {
+                value = value * 16 + digit;
+                if(value > 0x7FFFFFFF) return false;
+            }
+            words.push_back(value);
+            if(line_numbers) line_numbers->push_back(line_number);
         }
+
+        line = eol + 1;
     }
 
-    return words_read * 2; // expected: bytes read
+    return true;
+}
+
+bool read_whole_file(const std::string &filename, std::string &contents)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if(file.fail()) return false;
+
+    std::error_code error;
+    const uintmax_t size = fs::file_size(filename, error);
+    if(error) return false;
+
+    contents.resize(size);
+    file.read(contents.data(), size);
+    return (uintmax_t)file.gcount() == size;
+}
+
+// Returns bytes_read (after conversion) if everything went right, 0 if something went wrong
+uint16_t load_file_text(const std::string filename, uint16_t *buffer, uint16_t buffer_size)
+{
+    std::string text;
+    std::vector<uint16_t> words;
+
+    if(!read_whole_file(filename, text)) return 0;
+    if(!parse_listing(text.data(), text.size(), words)) return 0;
+    if(words.size() > buffer_size) return 0;       // Signal error on overflow
+
+    std::copy(words.begin(), words.end(), buffer);
+    return words.size() * 2; // expected: bytes read
 }
 
 uint16_t load_file(const std::string filename, uint16_t *buffer, uint16_t buffer_size)
@@ -69,3 +109,54 @@ uint16_t load_file(const std::string filename, uint16_t *buffer, uint16_t buffer
         return load_file_binary(filename, buffer, buffer_size);
     }
 }
+
+// Address in the first "// 0105" comment of a line: four hex digits, then
+// whitespace or the end of the line. Returns false if there is none.
+static bool address_comment(const char *line, const char *eol, uint16_t &address)
+{
+    for(const char *p = line; eol - p >= 2; p++) {
+        if(p[0] != '/' || p[1] != '/') continue;
+
+        const char *q = p + 2;
+        while(q < eol && isspace((unsigned char)*q)) q++;
+        if(eol - q < 4) continue;
+
+        unsigned value = 0, digits = 0;
+        for(int digit; digits < 4 && (digit = hex_digit(q[digits])) >= 0; digits++) value = value * 16 + digit;
+        if(digits < 4 || (q + 4 < eol && !isspace((unsigned char)q[4]))) continue;
+
+        address = value;
+        return true;
+    }
+    return false;
+}
+
+// Maps the words of a .cpu listing, as parse_listing() reads them, to their
+// line numbers. A word is at the address in its "// 0105 ..." comment if it
+// has one, otherwise right after the previous word (the first one at location).
+std::vector<ListingLine> load_listing_lines(const std::string filename, uint16_t location)
+{
+    std::vector<ListingLine> lines;
+    std::string text;
+    std::vector<uint16_t> words;
+    std::vector<unsigned> line_numbers;
+
+    if(!read_whole_file(filename, text)) return lines;
+    if(!parse_listing(text.data(), text.size(), words, &line_numbers)) return lines;
+
+    const char *end = text.data() + text.size();
+    const char *line = text.data();
+    unsigned line_number = 1;
+    uint16_t address = location;
+
+    for(const unsigned word_line : line_numbers) {
+        for(; line_number < word_line; line_number++) line = (const char *)memchr(line, '\n', end - line) + 1;
+
+        const char *eol = (const char *)memchr(line, '\n', end - line);
+        address_comment(line, eol ? eol : end, address);
+
+        lines.push_back({address++, word_line});
+    }
+
+    return lines;
+}
@@ -3,9 +3,27 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+// Source line of one word of a .cpu listing
+struct ListingLine {
+    uint16_t address;
+    unsigned line;
+};
+
+// Parses the text of a .cpu listing: one word per line, the first hex number
+// on it (0x prefix optional), skipping lines that start with ; or //. Appends
+// to words, and the 1-based line number of each word to line_numbers if
+// given; returns false if a number is out of range.
+bool parse_listing(const char *text, const size_t size, std::vector<uint16_t> &words,
+                   std::vector<unsigned> *line_numbers = nullptr);
+
+bool read_whole_file(const std::string &filename, std::string &contents);
 
 uint16_t load_file_binary(const std::string filename, uint16_t *buffer, uint16_t buffer_size);
 uint16_t load_file_text(const std::string filename, uint16_t *buffer, uint16_t buffer_size);
 uint16_t load_file(const std::string filename, uint16_t *buffer, uint16_t buffer_size);
 
+std::vector<ListingLine> load_listing_lines(const std::string filename, uint16_t location);
+
 #endif // TOOLS_H_
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "trace.h"
+
+#define TRACE_FILE_BUFFER (1 << 20)
+
+TraceSink::TraceSink(const std::string &filename, TracePolicy policy, unsigned ring_bits)
+    : ring(new TraceRecord[1ull << ring_bits]), mask((1ull << ring_bits) - 1), policy(policy)
+{
+    file = fopen(filename.c_str(), "wb");
+    if(!file) return;
+
+    setvbuf(file, nullptr, _IOFBF, TRACE_FILE_BUFFER);
+
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    if(fwrite(&header, sizeof(header), 1, file) != 1) write_error = true;
+
+    writer_thread = std::thread(&TraceSink::writer, this);
+}
+
+void TraceSink::close() {
+    if(!file) return;
+
+    closing.store(true, std::memory_order_release);
+    writer_thread.join();
+    if(fclose(file) != 0) write_error = true;
+    file = nullptr;
+}
+
+// Slow path of push(): the ring is full
+bool TraceSink::wait_for_space(uint64_t h) {
+    if(policy == TracePolicy::DROP) return false;
+
+    do {
+        std::this_thread::yield();
+        cached_tail = tail.load(std::memory_order_acquire);
+    } while(h - cached_tail > mask);
+
+    return true;
+}
+
+void TraceSink::writer() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+
+    while(true) {
+        // Read closing before head, so that nothing pushed before close is missed
+        const bool last = closing.load(std::memory_order_acquire);
+        const uint64_t h = head.load(std::memory_order_acquire);
+
+        if(h == t) {
+            if(last) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Write everything available, in at most two contiguous pieces
+        while(t != h) {
+            const uint64_t start = t & mask;
+            const uint64_t count = std::min(h - t, mask + 1 - start);
+            const size_t done = fwrite(&ring[start], sizeof(TraceRecord), count, file);
+            written_records.fetch_add(done, std::memory_order_release);
+            if(done < count) write_error = true;
+            t += count;
+            tail.store(t, std::memory_order_release);
+        }
+    }
+
+    if(fflush(file) != 0) write_error = true;
+}
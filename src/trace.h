@@ -0,0 +1,102 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Binary trace file: a TraceHeader followed by fixed-size TraceRecords,
+// both in host byte order.
+
+#define TRACE_MAGIC   "CPUTRACE"
+#define TRACE_VERSION 1
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct TraceRecord {
+    uint64_t seq;       // instruction number since tracing started
+    uint16_t pc;        // address of the instruction
+    uint16_t ir;        // instruction word
+    uint16_t ext;       // following word (immediate of two-word instructions)
+    uint16_t flags;     // FLAGS after execution
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes on disk");
+
+// What push() does when the writer thread has fallen a full ring behind
+enum class TracePolicy {
+    BLOCK,              // wait for the writer: lossless, slows the CPU down
+    DROP,               // discard the record and count it: seq numbers show gaps
+};
+
+// Trace sink: the CPU thread pushes records into a single-producer,
+// single-consumer ring; a background thread drains it to the file.
+class TraceSink {
+
+    std::unique_ptr<TraceRecord[]> ring;
+    const uint64_t mask;            // ring size - 1, size is a power of two
+
+    // producer side
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cached_tail = 0;       // last tail seen, to avoid touching the consumer's line
+    uint64_t seq = 0;
+    std::atomic<uint64_t> dropped_records{0};
+
+    // consumer side
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> closing{false};
+    std::atomic<uint64_t> written_records{0};
+    std::atomic<bool> write_error{false};
+
+    const TracePolicy policy;
+    FILE *file;
+    std::thread writer_thread;
+
+    void writer();
+    bool wait_for_space(uint64_t h);
+
+public:
+
+    TraceSink(const std::string &filename, TracePolicy policy, unsigned ring_bits = 16);
+    ~TraceSink() { close(); }
+
+    // drains the ring and closes the file; no push() may follow
+    void close();
+
+    TraceSink(const TraceSink &) = delete;
+    TraceSink &operator=(const TraceSink &) = delete;
+
+    bool ok() const { return file != nullptr; }
+
+    // called by the CPU thread, once per instruction
+    void push(uint16_t pc, uint16_t ir, uint16_t ext, uint16_t flags) {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+
+        if(h - cached_tail > mask) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(h - cached_tail > mask && !wait_for_space(h)) {
+                seq++;
+                dropped_records.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        ring[h & mask] = {seq++, pc, ir, ext, flags};
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // records accepted by the file; if failed(), a write, the final flush
+    // or the close went wrong and the file is incomplete
+    uint64_t written() const { return written_records.load(std::memory_order_acquire); }
+    uint64_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+    bool failed() const { return write_error.load(std::memory_order_acquire); }
+};
+
+#endif // TRACE_H_
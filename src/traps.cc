@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cpu.h"
+#include "traps.h"
+
+// Largest block summed in 32-bit lanes before folding, so lanes cannot overflow
+#define CHECKSUM_BLOCK 65536
+
+// Index of the first word that differs between a and b, or count if none does
+size_t words_mismatch(const uint16_t *a, const uint16_t *b, size_t count) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    for(; i + 8 <= count; i += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned equal = _mm_movemask_epi8(_mm_cmpeq_epi16(va, vb));
+        if(equal != 0xFFFF) return i + __builtin_ctz(~equal) / 2;
+    }
+#endif
+
+    for(; i < count; i++) {
+        if(a[i] != b[i]) return i;
+    }
+    return count;
+}
+
+uint16_t words_checksum(const uint16_t *words, size_t count) {
+    uint64_t sum = 0;
+
+    while(count) {
+        const size_t block = std::min<size_t>(count, CHECKSUM_BLOCK);
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for(; i + 8 <= block; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(words + i));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+        for(; i < block; i++) sum += words[i];
+
+        words += block;
+        count -= block;
+    }
+
+    // End-around carry
+    while(sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+
+// True if [start, start + count) lies within the CPU's memory
+static bool in_memory(const CPU &cpu, uint32_t start, uint32_t count) {
+    return start + count <= cpu.memory_size();
+}
+
+static bool trap_memcpy(CPU &cpu) {
+    const uint16_t dst = cpu.getreg(1), src = cpu.getreg(2), count = cpu.getreg(3);
+    if(!in_memory(cpu, dst, count) || !in_memory(cpu, src, count)) return false;
+
+    cpu.snoop_range(src, count);
+    cpu.snoop_range(dst, count);
+    memmove(cpu.memory() + dst, cpu.memory() + src, count * sizeof(uint16_t));
+    cpu.setreg(0, count);
+    return true;
+}
+
+static bool trap_memset(CPU &cpu) {
+    const uint16_t dst = cpu.getreg(1), value = cpu.getreg(2), count = cpu.getreg(3);
+    if(!in_memory(cpu, dst, count)) return false;
+
+    cpu.snoop_range(dst, count);
+    std::fill_n(cpu.memory() + dst, count, value);
+    cpu.setreg(0, count);
+    return true;
+}
+
+static bool trap_memcmp(CPU &cpu) {
+    const uint16_t a = cpu.getreg(1), b = cpu.getreg(2), count = cpu.getreg(3);
+    if(!in_memory(cpu, a, count) || !in_memory(cpu, b, count)) return false;
+
+    cpu.snoop_range(a, count);
+    cpu.snoop_range(b, count);
+    const uint16_t *mem = cpu.memory();
+    const size_t index = words_mismatch(mem + a, mem + b, count);
+
+    if(index == count) {
+        cpu.setreg(0, 0);
+    } else {
+        cpu.setreg(0, (mem[a + index] > mem[b + index]) ? 1 : 0xFFFF);
+    }
+    cpu.setreg(1, index);
+    return true;
+}
+
+static bool trap_checksum(CPU &cpu) {
+    const uint16_t start = cpu.getreg(1), count = cpu.getreg(2);
+    if(!in_memory(cpu, start, count)) return false;
+
+    cpu.snoop_range(start, count);
+    cpu.setreg(0, words_checksum(cpu.memory() + start, count));
+    return true;
+}
+
+void install_builtin_traps(CPU &cpu) {
+    cpu.register_trap(TRAP_MEMCPY, trap_memcpy);
+    cpu.register_trap(TRAP_MEMSET, trap_memset);
+    cpu.register_trap(TRAP_MEMCMP, trap_memcmp);
+    cpu.register_trap(TRAP_CHECKSUM, trap_checksum);
+}
@@ -0,0 +1,26 @@
+#ifndef TRAPS_H_
+#define TRAPS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+class CPU;
+
+// Built-in TRAP numbers. Lengths are in words; a range that does not fit
+// in memory fails with the carry flag set and memory untouched. Like guest
+// loads and stores, they first complete any DMA transfer they overlap.
+
+#define TRAP_MEMCPY    0x00    // copy r3 words from (r2) to (r1), overlap allowed; r0 <- r3
+#define TRAP_MEMSET    0x01    // fill r3 words at (r1) with r2; r0 <- r3
+#define TRAP_MEMCMP    0x02    // compare r3 words at (r1) and (r2), unsigned; r0 <- 0 if equal,
+                               // 1 if (r1) is above, -1 if below; r1 <- index of first difference
+#define TRAP_CHECKSUM  0x03    // r0 <- Internet (RFC 1071) checksum of r2 words at (r1)
+
+// Registers the built-in traps; the CPU constructor calls this
+void install_builtin_traps(CPU &cpu);
+
+// Bulk operations behind the built-in traps, usable by host code directly
+size_t words_mismatch(const uint16_t *a, const uint16_t *b, size_t count);
+uint16_t words_checksum(const uint16_t *words, size_t count);
+
+#endif // TRAPS_H_
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "uarch.h"
+
+static bool power_of_two(unsigned n) { return n && !(n & (n - 1)); }
+
+static unsigned bits_of(unsigned n) {
+    unsigned bits = 0;
+    while(n >>= 1) bits++;
+    return bits;
+}
+
+static std::vector<std::string> split(const std::string &text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while(std::getline(stream, part, separator)) parts.push_back(part);
+    return parts;
+}
+
+std::string Cache::parse(const std::string &spec, Cache &cache) {
+    std::vector<std::string> fields = split(spec, ':');
+    unsigned size, line;
+
+    if(fields.size() != 4 || fields[0].empty()) return "cache spec is name:size:ways:line: " + spec;
+
+    try {
+        size = std::stoul(fields[1]);
+        cache.ways = std::stoul(fields[2]);
+        line = std::stoul(fields[3]);
+    } catch(std::logic_error const &e) {
+        return "could not parse cache spec " + spec;
+    }
+
+    if(!power_of_two(line) || !cache.ways || size % (cache.ways * line) || !power_of_two(size / (cache.ways * line)))
+        return "cache " + fields[0] + ": line size and number of sets must be powers of two";
+
+    cache.level_name = fields[0];
+    cache.line_bits = bits_of(line);
+    cache.set_bits = bits_of(size / (cache.ways * line));
+    cache.tags.assign(size / line, 0);
+    cache.stamps.assign(size / line, 0);
+    cache.serves_fetches = fields[0].back() != 'd';
+    cache.serves_data = fields[0].back() != 'i';
+
+    return "";
+}
+
+bool Cache::access(const uint16_t address) {
+    const uint32_t line = address >> line_bits;
+    const uint32_t set = line & ((1u << set_bits) - 1);
+    uint32_t *set_tags = &tags[set * ways];
+    uint64_t *set_stamps = &stamps[set * ways];
+    unsigned victim = 0;
+
+    clock++;
+
+    for(unsigned way = 0; way < ways; way++) {
+        if(set_tags[way] == line + 1) {
+            set_stamps[way] = clock;
+            return true;
+        }
+        if(set_stamps[way] < set_stamps[victim]) victim = way;
+    }
+
+    set_tags[victim] = line + 1;
+    set_stamps[victim] = clock;
+    return false;
+}
+
+std::string BranchPredictor::parse(const std::string &spec, BranchPredictor &predictor) {
+    std::vector<std::string> fields = split(spec, ':');
+
+    if(fields.size() != 2 || (fields[0] != "bimodal" && fields[0] != "gshare"))
+        return "predictor spec is bimodal:bits or gshare:bits: " + spec;
+
+    try {
+        predictor.bits = std::stoul(fields[1]);
+    } catch(std::logic_error const &e) {
+        return "could not parse predictor spec " + spec;
+    }
+    if(predictor.bits < 1 || predictor.bits > 16) return "predictor table bits must be 1 to 16";
+
+    predictor.gshare = fields[0] == "gshare";
+    predictor.counters.assign(1u << predictor.bits, 1);     // weakly not taken
+    predictor.history = 0;
+
+    return "";
+}
+
+std::string BranchPredictor::name() const {
+    return (gshare ? "gshare:" : "bimodal:") + std::to_string(bits);
+}
+
+bool BranchPredictor::predict_and_update(const uint16_t address, const bool taken) {
+    const uint32_t mask = (1u << bits) - 1;
+    uint8_t &counter = counters[(gshare ? (address ^ history) : address) & mask];
+    const bool predicted = counter >= 2;
+
+    if(taken && counter < 3) counter++;
+    if(!taken && counter > 0) counter--;
+    history = ((history << 1) | taken) & mask;
+
+    return predicted == taken;
+}
+
+Uarch::Uarch() : sites(1 << 16), pages(1 << (16 - UARCH_PAGE_BITS)) {
+    configure(UARCH_DEFAULT_CACHES, UARCH_DEFAULT_PREDICTOR);
+}
+
+std::string Uarch::configure(const std::string &cache_specs, const std::string &predictor_spec) {
+    std::vector<Cache> levels;
+
+    for(const auto &spec : split(cache_specs, ',')) {
+        Cache cache;
+        std::string error = Cache::parse(spec, cache);
+        if(!error.empty()) return error;
+        levels.push_back(cache);
+    }
+
+    BranchPredictor new_predictor;
+    std::string error = BranchPredictor::parse(predictor_spec, new_predictor);
+    if(!error.empty()) return error;
+
+    caches = levels;
+    predictor = new_predictor;
+    clear();
+    return "";
+}
+
+void Uarch::clear() {
+    pending = 0;
+    for(auto &cache : caches) {
+        std::fill(std::begin(cache.hits), std::end(cache.hits), 0);
+        std::fill(std::begin(cache.misses), std::end(cache.misses), 0);
+    }
+    std::fill(sites.begin(), sites.end(), BranchSite());
+    std::fill(pages.begin(), pages.end(), Page());
+}
+
+void Uarch::process() {
+    for(unsigned i = 0; i < pending; i++) {
+        const UarchEvent &event = batch[i];
+
+        if(event.kind >= EVENT_BRANCH_NOT_TAKEN) {
+            BranchSite &site = sites[event.address];
+            site.executed++;
+            if(!predictor.predict_and_update(event.address, event.kind == EVENT_BRANCH_TAKEN))
+                site.mispredicted++;
+            continue;
+        }
+
+        Page &page = pages[event.address >> UARCH_PAGE_BITS];
+        if(event.kind == EVENT_FETCH) page.fetches++;
+        else if(event.kind == EVENT_READ) page.reads++;
+        else page.writes++;
+
+        // Walk down the hierarchy until a level hits
+        const bool fetch = event.kind == EVENT_FETCH;
+        for(auto &cache : caches) {
+            if(fetch ? !cache.serves_fetches : !cache.serves_data) continue;
+
+            if(cache.access(event.address)) {
+                cache.hits[event.kind]++;
+                break;
+            }
+            cache.misses[event.kind]++;
+        }
+    }
+
+    pending = 0;
+}
+
+// Report rows: a 12 character label, then the counts
+static void print_header(std::ostream &out, const char *title, const char *total, const char *misses) {
+    out << std::left << std::setw(12) << title << std::right
+        << std::setw(12) << total << std::setw(14) << misses << std::setw(10) << "rate" << std::endl;
+}
+
+static void print_rate(std::ostream &out, uint64_t hits, uint64_t misses) {
+    const uint64_t total = hits + misses;
+    out << std::setw(12) << total << std::setw(14) << misses;
+    if(total) {
+        out << std::fixed << std::setprecision(2) << std::setw(9) << 100.0 * misses / total << "%";
+    } else {
+        out << std::setw(10) << "-";
+    }
+    out << std::endl;
+}
+
+void Uarch::report(std::ostream &out) {
+    static const char *kinds[] = {"fetch", "read", "write"};
+
+    flush();
+    out << std::dec << std::setfill(' ');
+
+    print_header(out, "Cache", "accesses", "misses");
+    for(const auto &cache : caches) {
+        for(unsigned kind = EVENT_FETCH; kind <= EVENT_WRITE; kind++) {
+            if(!cache.hits[kind] && !cache.misses[kind]) continue;
+            out << std::left << std::setw(6) << cache.name() << std::setw(6) << kinds[kind] << std::right;
+            print_rate(out, cache.hits[kind], cache.misses[kind]);
+        }
+    }
+
+    // Branch sites, worst first
+    std::vector<uint32_t> addresses;
+    uint64_t executed = 0, mispredicted = 0;
+    for(uint32_t address = 0; address < sites.size(); address++) {
+        if(!sites[address].executed) continue;
+        addresses.push_back(address);
+        executed += sites[address].executed;
+        mispredicted += sites[address].mispredicted;
+    }
+    std::sort(addresses.begin(), addresses.end(), [this](uint32_t a, uint32_t b) {
+        return sites[a].mispredicted > sites[b].mispredicted;
+    });
+
+    out << std::endl << "Branch predictor " << predictor.name() << std::endl;
+    print_header(out, "Branch", "executed", "mispredicted");
+    out << std::left << std::setw(12) << "total" << std::right;
+    print_rate(out, executed - mispredicted, mispredicted);
+    for(size_t i = 0; i < addresses.size() && i < 10; i++) {
+        const BranchSite &site = sites[addresses[i]];
+        out << "  " << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << addresses[i]
+            << std::dec << std::setfill(' ') << "      ";
+        print_rate(out, site.executed - site.mispredicted, site.mispredicted);
+    }
+
+    out << std::endl << std::left << std::setw(12) << "Page" << std::right
+        << std::setw(12) << "fetches" << std::setw(14) << "reads" << std::setw(14) << "writes" << std::endl;
+    for(size_t page = 0; page < pages.size(); page++) {
+        const Page &p = pages[page];
+        if(!p.fetches && !p.reads && !p.writes) continue;
+        out << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << (page << UARCH_PAGE_BITS)
+            << std::dec << std::setfill(' ')
+            << "        " << std::setw(12) << p.fetches << std::setw(14) << p.reads << std::setw(14) << p.writes << std::endl;
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef UARCH_H_
+#define UARCH_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Microarchitecture analysis: guest memory accesses go through a model of a
+// cache hierarchy, conditional jumps through a branch predictor, and both
+// feed a per-page heat map. The CPU only appends events to a batch; the
+// models run when the batch fills up or a report is asked for.
+
+#define UARCH_BATCH      4096
+#define UARCH_PAGE_BITS  8          // heat map page: 256 words
+
+#define UARCH_DEFAULT_CACHES     "l1i:512:2:4,l1d:512:4:4,l2:4096:8:8"
+#define UARCH_DEFAULT_PREDICTOR  "gshare:10"
+
+enum UarchEventKind : uint16_t {
+    EVENT_FETCH = 0,                // instruction word fetch
+    EVENT_READ,                     // data load
+    EVENT_WRITE,                    // data store
+    EVENT_BRANCH_NOT_TAKEN,         // JMP.cc at address, not taken
+    EVENT_BRANCH_TAKEN,             // JMP.cc at address, taken
+    EVENT_KINDS
+};
+
+struct UarchEvent {
+    uint16_t address;
+    uint16_t kind;
+};
+
+// One set-associative, LRU, write-allocate cache level. Sizes are in words.
+class Cache {
+
+    std::string level_name;
+    unsigned ways, line_bits, set_bits;
+    std::vector<uint32_t> tags;     // sets * ways, 0 is an empty way
+    std::vector<uint64_t> stamps;   // last use of each way, for LRU
+    uint64_t clock = 0;
+
+public:
+
+    bool serves_fetches, serves_data;
+    uint64_t hits[3] = {0, 0, 0}, misses[3] = {0, 0, 0};   // by EVENT_FETCH/READ/WRITE
+
+    // spec is name:size:ways:line, e.g. l1d:512:4:4. A name ending in 'i' only
+    // caches instruction fetches, one ending in 'd' only data. Sets and line
+    // size must be powers of two. Returns an error message, empty if valid.
+    static std::string parse(const std::string &spec, Cache &cache);
+
+    const std::string &name() const { return level_name; }
+    bool access(const uint16_t address);     // true on hit
+};
+
+// Branch predictor with a table of 2-bit counters, indexed by the address of
+// the jump (bimodal) or by the address xor the global history (gshare)
+class BranchPredictor {
+
+    bool gshare = false;
+    unsigned bits = 10;
+    std::vector<uint8_t> counters;
+    uint32_t history = 0;
+
+public:
+
+    // spec is bimodal:bits or gshare:bits. Returns an error message, empty if valid.
+    static std::string parse(const std::string &spec, BranchPredictor &predictor);
+
+    std::string name() const;
+    bool predict_and_update(const uint16_t address, const bool taken);   // true if predicted right
+};
+
+class Uarch {
+
+    UarchEvent batch[UARCH_BATCH];
+    unsigned pending = 0;
+
+    std::vector<Cache> caches;
+    BranchPredictor predictor;
+
+    struct BranchSite { uint64_t executed = 0, mispredicted = 0; };
+    std::vector<BranchSite> sites;          // by address of the JMP.cc
+
+    struct Page { uint64_t fetches = 0, reads = 0, writes = 0; };
+    std::vector<Page> pages;
+
+    void process();
+
+public:
+
+    Uarch();
+
+    // Returns an error message, empty if valid
+    std::string configure(const std::string &cache_specs, const std::string &predictor_spec);
+
+    // called by the CPU
+    void record(const uint16_t address, const UarchEventKind kind) {
+        batch[pending++] = {address, kind};
+        if(pending == UARCH_BATCH) process();
+    }
+
+    void flush() { process(); }
+    void clear();
+    void report(std::ostream &out);     // flushes first
+
+    // after a flush
+    const Cache &cache(const unsigned level) const { return caches[level]; }
+    uint64_t mispredictions(const uint16_t address) const { return sites[address].mispredicted; }
+    uint64_t page_writes(const unsigned page) const { return pages[page].writes; }
+};
+
+#endif // UARCH_H_
@@ -1,5 +1,22 @@
 #include "vendor/unity.h"
+#include "../src/aluengine.h"
+#include "../src/asm.h"
+#include "../src/coverage.h"
 #include "../src/cpu.h"
+#include "../src/dma.h"
+#include "../src/isa.h"
+#include "../src/libcpu.h"
+#include "../src/tools.h"
+#include "../src/trace.h"
+#include "../src/traps.h"
+#include "../src/uarch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
 
 #define MEM_SIZE 512
 
@@ -90,6 +107,612 @@ void test_instruction_jabsi_pos_not_taken(void) {
     TEST_ASSERT_EQUAL_UINT16(0x0106, cpu.getPC());
 }
 
+void test_disassemble_instruction(void) {
+    char text[DISASM_INSTRUCTION_MAX];
+
+    format_instruction(0x00a3, 0, text);
+    TEST_ASSERT_EQUAL_STRING("LOAD r10, (r3)", text);
+    format_instruction(0x0350, 0xFF08, text);
+    TEST_ASSERT_EQUAL_STRING("LOAD r5, #$FF08", text);
+    format_instruction(0x1132, 0, text);
+    TEST_ASSERT_EQUAL_STRING("STORE (r2), #3", text);
+    format_instruction(0x21F1, 0, text);
+    TEST_ASSERT_EQUAL_STRING("ADC r15, r1", text);
+    format_instruction(0x3004, 0, text);
+    TEST_ASSERT_EQUAL_STRING("NOT r4", text);
+    format_instruction(0x5002, 0, text);
+    TEST_ASSERT_EQUAL_STRING("JMPR #$2", text);
+    format_instruction(0x5109, 0x0110, text);
+    TEST_ASSERT_EQUAL_STRING("JMP.NEQ #$110", text);
+    TEST_ASSERT_EQUAL_UINT32(3, format_instruction(0xF0FF, 0, text));
+    TEST_ASSERT_EQUAL_STRING("???", text);
+}
+
+void test_disassemble_range(void) {
+    CPU cpu(MEM_SIZE);
+
+    const uint16_t program[] = {0x0142, 0x0350, 0xFF08, 0xF800};
+    char text[4 * DISASM_LINE_MAX];
+    uint32_t next;
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    size_t len = cpu.disassemble(0x0100, 0x0104, text, sizeof(text), &next);
+    text[len] = '\0';
+
+    TEST_ASSERT_EQUAL_STRING("0100  0142       LOAD r4, #2\n"
+                             "0101  0350 FF08  LOAD r5, #$FF08\n"
+                             "0103  F800       HALT\n", text);
+    TEST_ASSERT_EQUAL_UINT32(0x0104, next);
+
+    // Output buffer only large enough for one line
+    len = cpu.disassemble(0x0100, 0x0104, text, DISASM_LINE_MAX, &next);
+    TEST_ASSERT_EQUAL_UINT32(0x0101, next);
+}
+
+void test_opcode_table_matches_execution(void) {
+    for(unsigned opcode = 0; opcode < 256; opcode++) {
+        CPU cpu(MEM_SIZE);
+        const uint16_t program[] = {(uint16_t)(opcode << 8), 0x0000};
+
+        cpu.loadmem(program, sizeof(program), 0x0100);
+        cpu.reset();
+        cpu.run_once();
+
+        bool illegal = opcode_table[opcode].operands == OPERANDS_ILLEGAL;
+        bool halted = cpu.halted() && opcode != 0xF8;
+        TEST_ASSERT_EQUAL_MESSAGE(illegal, halted, "opcode table disagrees with run_once()");
+    }
+}
+
+void test_trace_sink_block_is_lossless(void) {
+    const std::string filename = (std::filesystem::temp_directory_path() / "cpu_test_trace.bin").string();
+    const uint64_t records = 1000000;
+
+    TraceSink sink(filename, TracePolicy::BLOCK, 8);
+    TEST_ASSERT_TRUE(sink.ok());
+
+    for(uint64_t i = 0; i < records; i++) sink.push(i & 0xFFFF, 0xFFFF, 0, 0);
+    sink.close();
+
+    TEST_ASSERT_EQUAL_UINT64(records, sink.written());
+    TEST_ASSERT_EQUAL_UINT64(0, sink.dropped());
+    TEST_ASSERT_FALSE(sink.failed());
+
+    FILE *file = fopen(filename.c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    fseek(file, sizeof(TraceHeader) + (records - 1) * sizeof(TraceRecord), SEEK_SET);
+    TraceRecord last;
+    TEST_ASSERT_EQUAL(1, fread(&last, sizeof(last), 1, file));
+    TEST_ASSERT_EQUAL_UINT64(records - 1, last.seq);
+    TEST_ASSERT_EQUAL(0, fread(&last, sizeof(last), 1, file));
+    fclose(file);
+    remove(filename.c_str());
+}
+
+void test_trace_sink_reports_write_errors(void) {
+    // Every write to /dev/full fails with ENOSPC once the stdio buffer fills
+    if(!std::filesystem::exists("/dev/full")) TEST_IGNORE_MESSAGE("no /dev/full");
+
+    const uint64_t records = 200000;
+    TraceSink sink("/dev/full", TracePolicy::BLOCK, 8);
+    TEST_ASSERT_TRUE(sink.ok());
+
+    for(uint64_t i = 0; i < records; i++) sink.push(i & 0xFFFF, 0xFFFF, 0, 0);
+    sink.close();
+
+    TEST_ASSERT_TRUE(sink.failed());
+    TEST_ASSERT_TRUE(sink.written() < records);
+}
+
+void test_coverage_blocks_and_branches(void) {
+    CPU cpu(MEM_SIZE);
+    Coverage coverage(MEM_SIZE);
+
+    // Loop twice around a JMP.NEQ, then fall through to HALT
+    const uint16_t program[] = {0x0102, 0x0110, 0x0121, 0x2012, 0x4010, 0x5109, 0x0103, 0xF800};
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+    cpu.set_coverage(&coverage);
+    while(!cpu.halted()) cpu.run_once();
+
+    std::vector<uint64_t> hits = coverage.instruction_hits(cpu.memory());
+    TEST_ASSERT_EQUAL_UINT64(1, hits[0x0100]);
+    TEST_ASSERT_EQUAL_UINT64(2, hits[0x0103]);
+    TEST_ASSERT_EQUAL_UINT64(2, hits[0x0105]);
+    TEST_ASSERT_EQUAL_UINT64(2, hits[0x0106]);     // immediate word of the JMP
+    TEST_ASSERT_EQUAL_UINT64(1, hits[0x0107]);
+    TEST_ASSERT_EQUAL_UINT64(0, hits[0x0108]);
+    TEST_ASSERT_EQUAL_UINT8(BRANCH_TAKEN | BRANCH_NOT_TAKEN, coverage.branch_directions(0x0105));
+}
+
+void test_performance_counters(void) {
+    CPU cpu(MEM_SIZE);
+
+    // r1 <- 0x01F0; STORE (r1), r2; LOAD r3, (r1); JMPR 0; then read the counters
+    const uint16_t program[] = {0x0310, 0x01F0, 0x1012, 0x0031, 0x5000,
+                                0x6040, 0x6054, 0x6068, 0x607C, 0x6081, 0xF800};
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+    while(!cpu.halted()) cpu.run_once();
+
+    TEST_ASSERT_EQUAL_UINT16(4, cpu.getreg(4));    // retired before the first RDCTR
+    TEST_ASSERT_EQUAL_UINT16(1, cpu.getreg(5));    // taken branches
+    TEST_ASSERT_EQUAL_UINT16(1, cpu.getreg(6));    // loads
+    TEST_ASSERT_EQUAL_UINT16(1, cpu.getreg(7));    // stores
+    TEST_ASSERT_EQUAL_UINT16(0, cpu.getreg(8));    // retired, second word
+    TEST_ASSERT_EQUAL_UINT64(10, cpu.counter(COUNTER_RETIRED));
+    TEST_ASSERT_EQUAL_UINT64(0, cpu.counter(COUNTERS));
+
+    // An illegal opcode halts without retiring
+    const uint16_t illegal[] = {0xFF00, 0x0400};
+
+    cpu.loadmem(illegal, sizeof(illegal), 0x0100);
+    cpu.reset();
+    while(!cpu.halted()) cpu.run_once();
+
+    TEST_ASSERT_EQUAL_UINT64(1, cpu.counter(COUNTER_RETIRED));
+    TEST_ASSERT_EQUAL_UINT16(FAULT_ILLEGAL_OPCODE, cpu.fault());
+}
+
+void test_trap_builtins(void) {
+    CPU cpu(MEM_SIZE);
+
+    // memset 0x0180..0x018F to 0xA5A5, copy to 0x01A0, compare, change one word, compare again
+    const uint16_t program[] = {0x0310, 0x0180, 0x0320, 0xA5A5, 0x0330, 0x0010, 0x7001,
+                                0x0310, 0x01A0, 0x0320, 0x0180, 0x7000,
+                                0x0310, 0x0180, 0x0320, 0x01A0, 0x7002, 0x0240,
+                                0x0310, 0x0185, 0x1111, 0x0310, 0x0180, 0x7002,
+                                0xF800};
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+    while(!cpu.halted()) cpu.run_once();
+
+    TEST_ASSERT_EQUAL_UINT16(0xA5A5, cpu.getmem_at(0x01AF));
+    TEST_ASSERT_EQUAL_UINT16(0, cpu.getreg(4));            // first compare: equal
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, cpu.getreg(0));       // 0x0001 is below 0xA5A5
+    TEST_ASSERT_EQUAL_UINT16(5, cpu.getreg(1));            // at index 5
+    TEST_ASSERT_TRUE(cpu.negative());
+    TEST_ASSERT_FALSE(cpu.carry());
+}
+
+void test_trap_errors_and_custom_handlers(void) {
+    CPU cpu(MEM_SIZE);
+
+    // memset out of memory, then a custom trap, then an unregistered one
+    const uint16_t program[] = {0x0310, 0x01F8, 0x0330, 0x0010, 0x7001, 0x0240, 0x7080, 0x7081};
+
+    cpu.register_trap(0x80, [](CPU &c) { c.setreg(0, c.getreg(4) + 0x1000); return true; });
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+    cpu.setreg(0, 0x55);
+    cpu.run_once();
+    cpu.run_once();
+    cpu.run_once();
+
+    TEST_ASSERT_TRUE(cpu.carry());                         // range does not fit in memory
+    cpu.run_once();
+    cpu.run_once();
+    TEST_ASSERT_EQUAL_UINT16(0x1055, cpu.getreg(0));       // the failed trap left r0 alone
+    TEST_ASSERT_FALSE(cpu.carry());
+    cpu.run_once();
+    TEST_ASSERT_TRUE(cpu.halted());
+    TEST_ASSERT_EQUAL_UINT64(5, cpu.counter(COUNTER_RETIRED));   // the unhandled trap does not retire
+    TEST_ASSERT_EQUAL_UINT16(FAULT_UNHANDLED_TRAP, cpu.fault());
+}
+
+void test_checksum(void) {
+    // RFC 1071 example, as 16-bit words
+    const uint16_t words[] = {0x0001, 0xf203, 0xf4f5, 0xf6f7};
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)~0xddf2, words_checksum(words, 4));
+
+    uint16_t big[1000];
+    for(int i = 0; i < 1000; i++) big[i] = i * 7919;
+    uint32_t sum = 0;
+    for(int i = 0; i < 1000; i++) sum += big[i];
+    while(sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)~sum, words_checksum(big, 1000));
+}
+
+void test_dma_overlaps_execution(void) {
+    CPU cpu(MEM_SIZE);
+    DmaController dma(cpu, 16);
+    uint16_t source[64];
+
+    const uint16_t loop[] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+                             0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+                             0x5100, 0x0100};                       // 16 NOPs, JMP #$100
+
+    for(int i = 0; i < 64; i++) source[i] = 0x1000 + i;
+    cpu.loadmem(source, sizeof(source), 0x0180);
+    cpu.loadmem(loop, sizeof(loop), 0x0100);
+
+    cpu.attach_device(&dma, 0x10, DMA_PORTS);
+    cpu.reset();
+    cpu.port_write(0x10 + DMA_PORT_SRC, 0x0180);
+    cpu.port_write(0x10 + DMA_PORT_DST, 0x01C0);
+    cpu.port_write(0x10 + DMA_PORT_LEN, 64);
+    cpu.port_write(0x10 + DMA_PORT_CTRL, DMA_CTRL_START);
+    TEST_ASSERT_EQUAL_UINT16(DMA_STATUS_BUSY, cpu.port_read(0x10 + DMA_PORT_CTRL));
+
+    // One chunk per DEVICE_TICK_INSTRUCTIONS
+    for(int i = 0; i < DEVICE_TICK_INSTRUCTIONS; i++) cpu.run_once();
+    TEST_ASSERT_EQUAL_UINT16(16, cpu.port_read(0x10 + DMA_PORT_COUNT));
+    TEST_ASSERT_TRUE(dma.busy());
+
+    for(int i = 0; i < 3 * DEVICE_TICK_INSTRUCTIONS; i++) cpu.run_once();
+    TEST_ASSERT_EQUAL_UINT16(DMA_STATUS_DONE, cpu.port_read(0x10 + DMA_PORT_CTRL));
+    TEST_ASSERT_EQUAL_UINT16(0x1000, cpu.getmem_at(0x01C0));
+    TEST_ASSERT_EQUAL_UINT16(0x103F, cpu.getmem_at(0x01FF));
+}
+
+void test_dma_guest_store_wins_over_pending_transfer(void) {
+    CPU cpu(MEM_SIZE);
+    DmaController dma(cpu, 16);
+
+    // Program the controller from the guest, then store into the destination
+    const uint16_t program[] = {0x0310, 0x0010, 0x0320, 0x0000, 0x8012,    // SRC = 0
+                                0x0310, 0x0011, 0x0320, 0x0180, 0x8012,    // DST = 0x180
+                                0x0310, 0x0012, 0x0320, 0x0080, 0x8012,    // LEN = 0x80
+                                0x0310, 0x0014, 0x0121, 0x8012,            // start
+                                0x0330, 0x01F0, 0x1173,                    // STORE (r3), #7
+                                0x0231, 0x8153, 0xF800};                   // IN r5, (r3)
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.attach_device(&dma, 0x10, DMA_PORTS);
+    cpu.reset();
+    while(!cpu.halted()) cpu.run_once();
+
+    TEST_ASSERT_EQUAL_UINT16(7, cpu.getmem_at(0x01F0));
+    TEST_ASSERT_EQUAL_UINT16(cpu.getmem_at(0x0071), cpu.getmem_at(0x01F1));
+    TEST_ASSERT_EQUAL_UINT16(DMA_STATUS_DONE, cpu.getreg(5));
+}
+
+void test_dma_runs_past_accesses_between_buffers(void) {
+    CPU cpu(MEM_SIZE);
+    DmaController dma(cpu, 16);
+    uint16_t source[32];
+
+    // STORE (r1), r2; LOAD r3, (r1) with r1 = $0150, between source and destination
+    const uint16_t program[] = {0x0310, 0x0150, 0x1012, 0x0031, 0xF800};
+
+    for(int i = 0; i < 32; i++) source[i] = 0x2000 + i;
+    cpu.loadmem(source, sizeof(source), 0x0040);
+    cpu.loadmem(program, sizeof(program), 0x0100);
+
+    cpu.attach_device(&dma, 0x10, DMA_PORTS);
+    cpu.reset();
+    cpu.port_write(0x10 + DMA_PORT_SRC, 0x0040);
+    cpu.port_write(0x10 + DMA_PORT_DST, 0x01C0);
+    cpu.port_write(0x10 + DMA_PORT_LEN, 32);
+    cpu.port_write(0x10 + DMA_PORT_CTRL, DMA_CTRL_START);
+    while(!cpu.halted()) cpu.run_once();
+
+    TEST_ASSERT_TRUE(dma.busy());
+    TEST_ASSERT_EQUAL_UINT16(0, cpu.port_read(0x10 + DMA_PORT_COUNT));
+
+    while(dma.busy()) cpu.tick_devices();
+    TEST_ASSERT_EQUAL_UINT16(0x2000, cpu.getmem_at(0x01C0));
+    TEST_ASSERT_EQUAL_UINT16(0x201F, cpu.getmem_at(0x01DF));
+}
+
+void test_dma_traps_see_pending_transfer(void) {
+    CPU cpu(MEM_SIZE);
+    DmaController dma(cpu, 16);
+    uint16_t source[64];
+
+    // TRAP #MEMSET 4 words of the destination, then TRAP #MEMCPY 4 more of it
+    // to $0080, all before the controller has had a tick
+    const uint16_t program[] = {0x0310, 0x01D0, 0x0320, 0xAAAA, 0x0134, 0x7001,
+                                0x0310, 0x0080, 0x0320, 0x01F0, 0x0134, 0x7000, 0xF800};
+
+    for(int i = 0; i < 64; i++) source[i] = 0x1000 + i;
+    cpu.loadmem(source, sizeof(source), 0x0180);
+    cpu.loadmem(program, sizeof(program), 0x0100);
+
+    cpu.attach_device(&dma, 0x10, DMA_PORTS);
+    cpu.reset();
+    cpu.port_write(0x10 + DMA_PORT_SRC, 0x0180);
+    cpu.port_write(0x10 + DMA_PORT_DST, 0x01C0);
+    cpu.port_write(0x10 + DMA_PORT_LEN, 64);
+    cpu.port_write(0x10 + DMA_PORT_CTRL, DMA_CTRL_START);
+    while(!cpu.halted()) cpu.run_once();
+    while(dma.busy()) cpu.tick_devices();
+
+    TEST_ASSERT_EQUAL_UINT16(DMA_STATUS_DONE, cpu.port_read(0x10 + DMA_PORT_CTRL));
+    TEST_ASSERT_EQUAL_UINT16(0xAAAA, cpu.getmem_at(0x01D0));   // not overwritten by the copy
+    TEST_ASSERT_EQUAL_UINT16(0x1030, cpu.getmem_at(0x0080));   // copied after the transfer
+    TEST_ASSERT_EQUAL_UINT16(0x1033, cpu.getmem_at(0x0083));
+}
+
+void test_dma_host_source(void) {
+    CPU cpu(MEM_SIZE);
+    DmaController dma(cpu);
+    uint16_t next = 0;
+
+    dma.set_source([&next](uint16_t *buffer, size_t count) {
+        size_t n = std::min<size_t>(count, 100 - next);
+        for(size_t i = 0; i < n; i++) buffer[i] = next++;
+        return n;
+    });
+    cpu.attach_device(&dma, 0, DMA_PORTS);
+    cpu.port_write(DMA_PORT_DST, 0x0100);
+    cpu.port_write(DMA_PORT_LEN, 200);
+    cpu.port_write(DMA_PORT_MODE, DMA_MODE_HOST);
+    cpu.port_write(DMA_PORT_CTRL, DMA_CTRL_START);
+    while(dma.busy()) cpu.tick_devices();
+
+    TEST_ASSERT_EQUAL_UINT16(DMA_STATUS_DONE | DMA_STATUS_ERROR, cpu.port_read(DMA_PORT_CTRL));
+    TEST_ASSERT_EQUAL_UINT16(100, cpu.port_read(DMA_PORT_COUNT));
+    TEST_ASSERT_EQUAL_UINT16(99, cpu.getmem_at(0x0163));
+}
+
+void test_uarch_cache_and_predictor(void) {
+    CPU cpu(MEM_SIZE);
+    Uarch uarch;
+
+    // One direct mapped level of four 4-word lines; the loop from the coverage test
+    TEST_ASSERT_EQUAL_STRING("", uarch.configure("l1:16:1:4", "bimodal:4").c_str());
+    TEST_ASSERT_NOT_EQUAL(0, uarch.configure("l1:24:1:4", "bimodal:4").size());
+    TEST_ASSERT_NOT_EQUAL(0, uarch.configure("l1:16:1:4", "perceptron:4").size());
+
+    const uint16_t program[] = {0x0102, 0x0110, 0x0121, 0x2012, 0x4010, 0x5109, 0x0103, 0xF800};
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+    cpu.set_uarch(&uarch);
+    while(!cpu.halted()) cpu.run_once();
+    uarch.flush();
+
+    TEST_ASSERT_EQUAL_UINT64(10, uarch.cache(0).hits[EVENT_FETCH]);
+    TEST_ASSERT_EQUAL_UINT64(2, uarch.cache(0).misses[EVENT_FETCH]);
+    TEST_ASSERT_EQUAL_UINT64(2, uarch.mispredictions(0x0105));     // taken, then not taken
+
+    // A store misses, and lands in its page of the heat map
+    const uint16_t store[] = {0x0310, 0x0080, 0x1012, 0xF800};
+
+    TEST_ASSERT_EQUAL_STRING("", uarch.configure("l1:16:1:4", "gshare:4").c_str());
+    cpu.loadmem(store, sizeof(store), 0x0100);
+    cpu.reset();
+    while(!cpu.halted()) cpu.run_once();
+    uarch.flush();
+
+    TEST_ASSERT_EQUAL_UINT64(1, uarch.cache(0).misses[EVENT_WRITE]);
+    TEST_ASSERT_EQUAL_UINT64(1, uarch.page_writes(0x0080 >> UARCH_PAGE_BITS));
+    TEST_ASSERT_EQUAL_UINT64(0, uarch.page_writes(0x0100 >> UARCH_PAGE_BITS));
+}
+
+static uint16_t port_echo(void *, uint16_t port) {
+    return 0x0100 + port;
+}
+
+static void port_record(void *user, uint16_t port, uint16_t value) {
+    ((uint16_t *)user)[port] = value;
+}
+
+void test_c_api(void) {
+    libcpu *cpu = cpu_create(LIBCPU_MEM_WORDS);
+    uint16_t written[4] = {0, 0, 0, 0};
+    libcpu_regs regs;
+
+    TEST_ASSERT_NOT_NULL(cpu);
+    TEST_ASSERT_NULL(cpu_create(MEM_SIZE));
+
+    // r1 <- 5, r2 <- 3, OUT (r2), r1, IN r3, (r2), HALT; ports 2-5 go to the callbacks
+    const uint16_t program[] = {0x0115, 0x0123, 0x8021, 0x8132, 0xF800};
+    uint16_t readback[5];
+
+    TEST_ASSERT_EQUAL_INT(LIBCPU_OK, cpu_attach_ports(cpu, 2, 4, port_echo, port_record, written));
+    TEST_ASSERT_EQUAL_INT(LIBCPU_OK, cpu_mem_write(cpu, 0x0100, program, 5));
+    TEST_ASSERT_EQUAL_INT(LIBCPU_ERR_RANGE, cpu_mem_write(cpu, LIBCPU_MEM_WORDS - 4, program, 5));
+    TEST_ASSERT_EQUAL_INT(LIBCPU_OK, cpu_mem_read(cpu, 0x0100, readback, 5));
+    TEST_ASSERT_EQUAL_HEX16_ARRAY(program, readback, 5);
+
+    TEST_ASSERT_EQUAL_UINT64(2, cpu_run(cpu, 2));
+    TEST_ASSERT_FALSE(cpu_halted(cpu));
+    TEST_ASSERT_EQUAL_UINT64(3, cpu_run(cpu, 1000000));
+    TEST_ASSERT_TRUE(cpu_halted(cpu));
+    TEST_ASSERT_EQUAL_INT(LIBCPU_FAULT_NONE, cpu_fault(cpu));
+    TEST_ASSERT_EQUAL_UINT64(0, cpu_run(cpu, 1000000));
+
+    cpu_get_regs(cpu, &regs);
+    TEST_ASSERT_EQUAL_HEX16(5, regs.r[1]);
+    TEST_ASSERT_EQUAL_HEX16(0x0101, regs.r[3]);
+    TEST_ASSERT_EQUAL_HEX16(0x0105, regs.pc);
+    TEST_ASSERT_EQUAL_HEX16(5, written[1]);
+
+    uint64_t counters[LIBCPU_COUNTERS];
+    cpu_get_counters(cpu, counters);
+    TEST_ASSERT_EQUAL_UINT64(5, counters[COUNTER_RETIRED]);
+
+    // Restart at the OUT with a different value
+    regs.r[1] = 0x1234;
+    regs.pc = 0x0102;
+    regs.flags = 0;
+    cpu_set_regs(cpu, &regs);
+    TEST_ASSERT_EQUAL_UINT64(3, cpu_run(cpu, 1000000));
+    TEST_ASSERT_EQUAL_HEX16(0x1234, written[1]);
+
+    // Faults are reported through the API, not printed
+    const uint16_t illegal = 0x0400;
+    TEST_ASSERT_EQUAL_INT(LIBCPU_OK, cpu_mem_write(cpu, 0x0200, &illegal, 1));
+    regs.pc = 0x0200;
+    regs.flags = 0;
+    cpu_set_regs(cpu, &regs);
+    TEST_ASSERT_EQUAL_UINT64(1, cpu_run(cpu, 1000000));
+    TEST_ASSERT_EQUAL_INT(LIBCPU_FAULT_ILLEGAL_OPCODE, cpu_fault(cpu));
+
+    cpu_destroy(cpu);
+}
+
+// An ALU that gets the carry of ADD "right"
+class CarryingAlu : public AluEngine {
+public:
+    void evaluate(const AluOp op, const uint16_t a, const uint16_t *b, const size_t count,
+                  const uint16_t flags_in, uint16_t *result, uint16_t *flags) override {
+        alu_engine("reference")()->evaluate(op, a, b, count, flags_in, result, flags);
+        for(size_t i = 0; op == ALU_ADD && i < count; i++) {
+            if(a + b[i] > 0xFFFF) flags[i] |= FLAGS_CARRY;
+        }
+    }
+};
+
+void test_alu_verifier(void) {
+    AluEngineFactory reference = alu_engine("reference");
+
+    for(unsigned op = 0; op < ALU_OPS; op++) {
+        AluReport cpu = verify_alu(alu_engine("cpu"), reference, (AluOp)op, 2, 1021);
+        AluReport interpreter = verify_alu(alu_engine("interpreter"), reference, (AluOp)op, 2, 4099);
+
+        TEST_ASSERT_EQUAL_UINT64(0, cpu.mismatches);
+        TEST_ASSERT_EQUAL_UINT64(0, interpreter.mismatches);
+    }
+
+    AluReport broken = verify_alu([]() { return std::make_unique<CarryingAlu>(); }, reference, ALU_ADD, 2, 4099);
+    TEST_ASSERT_EQUAL_UINT64(16 * 0x10000, broken.checked);
+    TEST_ASSERT_NOT_EQUAL(0, broken.mismatches);
+    TEST_ASSERT_EQUAL(ALU_MAX_REPORTED, broken.first.size());
+    TEST_ASSERT_TRUE(broken.first[0].flags & FLAGS_CARRY);
+}
+
+void test_parse_listing(void) {
+    const char text[] =
+        "; comment 1234\n"
+        "// 0100 also a comment\n"
+        "0350  // 0100 LOAD r5, #$FF08\n"
+        "0xff08\n"
+        "\n"
+        "  LOAD r1, r2\r\n"               // first hex digits anywhere: AD
+        "0xZ1\n"                           // no digits after 0x: just 0
+        "1FFFF";                            // truncated, no final newline
+    const uint16_t expected[] = {0x0350, 0xFF08, 0x00AD, 0x0000, 0xFFFF};
+    std::vector<uint16_t> words;
+
+    TEST_ASSERT_TRUE(parse_listing(text, strlen(text), words));
+    TEST_ASSERT_EQUAL(5, words.size());
+    TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, words.data(), 5);
+
+    std::vector<unsigned> line_numbers;
+    const unsigned expected_lines[] = {3, 4, 6, 7, 8};
+    words.clear();
+    TEST_ASSERT_TRUE(parse_listing(text, strlen(text), words, &line_numbers));
+    TEST_ASSERT_EQUAL(5, line_numbers.size());
+    TEST_ASSERT_EQUAL_UINT_ARRAY(expected_lines, line_numbers.data(), 5);
+
+    // The coverage report's addresses follow the same words, from the "// 0100" comment on
+    const std::string filename = (std::filesystem::temp_directory_path() / "cpu_test_listing.cpu").string();
+    FILE *file = fopen(filename.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    fwrite(text, 1, strlen(text), file);
+    fclose(file);
+
+    std::vector<ListingLine> lines = load_listing_lines(filename, 0x0300);
+    remove(filename.c_str());
+    TEST_ASSERT_EQUAL(5, lines.size());
+    for(unsigned i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL_HEX16(0x0100 + i, lines[i].address);
+        TEST_ASSERT_EQUAL(expected_lines[i], lines[i].line);
+    }
+
+    const char too_big[] = "80000000\n";
+    TEST_ASSERT_FALSE(parse_listing(too_big, strlen(too_big), words));
+}
+
+void test_assembler_round_trips_disassembly(void) {
+    const uint16_t params[] = {0x00, 0x08, 0x5A, 0xF3};     // 0x08: JMPUNDEFINED
+
+    for(unsigned op = 0; op < opcode_table.size(); op++) {
+        if(opcode_table[op].operands == OPERANDS_ILLEGAL) continue;
+
+        for(uint16_t param : params) {
+            char text[DISASM_INSTRUCTION_MAX], again[DISASM_INSTRUCTION_MAX];
+            AsmImage image;
+
+            format_instruction(op << 8 | param, 0x1234, text);
+            TEST_ASSERT_TRUE_MESSAGE(assemble(text, strlen(text), image), text);
+            TEST_ASSERT_EQUAL_MESSAGE(opcode_table[op].words, image.words.size(), text);
+
+            format_instruction(image.words[0], image.words.size() > 1 ? image.words[1] : 0, again);
+            TEST_ASSERT_EQUAL_STRING(text, again);
+        }
+    }
+}
+
+void test_assembler_labels_and_constants(void) {
+    CPU cpu(MEM_SIZE);
+    AsmImage image;
+
+    // Sum 1..LIMIT into r1 and store it at result
+    const char source[] =
+        "LIMIT = 10\n"
+        "        LOAD r3, #result    // forward: takes the 16-bit form\n"
+        "loop:   ADD r1, r2\n"
+        "        CMP r2, #LIMIT\n"
+        "        JMP.EQ done\n"
+        "        LOAD r4, #1\n"
+        "        ADD r2, r4\n"
+        "        JMP loop\n"
+        "done:   STORE (r3), r1 ; 0 + 1 + ... + 10\n"
+        "        JMPR end\n"
+        "        NOP\n"
+        "end:    HALT\n"
+        "        .org $0180\n"
+        "result: .word 0, result + 1\n";
+
+    TEST_ASSERT_TRUE(assemble(source, strlen(source), image));
+    TEST_ASSERT_EQUAL_HEX16(0x0100, image.origin);
+    TEST_ASSERT_EQUAL_HEX16(0x0180, image.symbols["result"]);
+    TEST_ASSERT_EQUAL(0x82, image.words.size());
+    TEST_ASSERT_EQUAL_HEX16(0x0330, image.words[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x0180, image.words[1]);
+    TEST_ASSERT_EQUAL_HEX16(0x412A, image.words[3]);
+    TEST_ASSERT_EQUAL_HEX16(0x5001, image.words[0x0B]);     // JMPR over the NOP
+    TEST_ASSERT_EQUAL_HEX16(0x0181, image.words[0x81]);
+
+    cpu.loadmem(image.words.data(), image.words.size() * sizeof(uint16_t), image.origin);
+    cpu.reset();
+    for(unsigned i = 0; i < 1000 && !cpu.halted(); i++) cpu.run_once();
+
+    TEST_ASSERT_TRUE(cpu.halted());
+    TEST_ASSERT_EQUAL_HEX16(55, cpu.getmem_at(0x0180));
+}
+
+void test_assembler_errors(void) {
+    AsmImage image;
+    const char source[] =
+        "start: ADD r1, #3\n"          // no ADD with an immediate
+        "       JMP nowhere\n"          // undefined
+        "       JMPR start\n"           // JMPR only goes forwards
+        "start: NOP\n"                  // defined twice
+        "       STORE (r1), #16\n"      // imm4 only
+        "       FROB r1\n";
+
+    TEST_ASSERT_FALSE(assemble(source, strlen(source), image));
+    TEST_ASSERT_EQUAL(6, image.errors.size());
+
+    std::vector<unsigned> lines;
+    for(const auto &error : image.errors) lines.push_back(error.line);
+    std::sort(lines.begin(), lines.end());
+    for(unsigned i = 0; i < 6; i++) TEST_ASSERT_EQUAL(i + 1, lines[i]);
+}
+
+void test_progress_snapshot(void) {
+    CPU cpu(MEM_SIZE);
+
+    // r1 <- 0x01F0; STORE (r1), r2; LOAD r3, (r1); JMPR 0; HALT
+    const uint16_t program[] = {0x0310, 0x01F0, 0x1012, 0x0031, 0x5000, 0xF800};
+
+    cpu.loadmem(program, sizeof(program), 0x0100);
+    cpu.reset();
+
+    // run() publishes the address of the last instruction it executed
+    TEST_ASSERT_EQUAL_UINT64(4, cpu.run(4));
+    TEST_ASSERT_EQUAL_HEX64((4ull << 16) | 0x0104, cpu.progress_snapshot());
+    TEST_ASSERT_EQUAL_UINT64(1, cpu.run(100));
+    TEST_ASSERT_EQUAL_HEX64((5ull << 16) | 0x0105, cpu.progress_snapshot());
+}
 
 int main(void) {
     UNITY_BEGIN();
@@ -99,5 +722,28 @@ int main(void) {
     RUN_TEST(test_instruction_jabsi_eq_not_taken);
     RUN_TEST(test_instruction_jabsi_neg_taken);
     RUN_TEST(test_instruction_jabsi_pos_not_taken);
+    RUN_TEST(test_disassemble_instruction);
+    RUN_TEST(test_disassemble_range);
+    RUN_TEST(test_opcode_table_matches_execution);
+    RUN_TEST(test_trace_sink_block_is_lossless);
+    RUN_TEST(test_trace_sink_reports_write_errors);
+    RUN_TEST(test_coverage_blocks_and_branches);
+    RUN_TEST(test_performance_counters);
+    RUN_TEST(test_trap_builtins);
+    RUN_TEST(test_trap_errors_and_custom_handlers);
+    RUN_TEST(test_checksum);
+    RUN_TEST(test_dma_overlaps_execution);
+    RUN_TEST(test_dma_guest_store_wins_over_pending_transfer);
+    RUN_TEST(test_dma_runs_past_accesses_between_buffers);
+    RUN_TEST(test_dma_traps_see_pending_transfer);
+    RUN_TEST(test_dma_host_source);
+    RUN_TEST(test_uarch_cache_and_predictor);
+    RUN_TEST(test_c_api);
+    RUN_TEST(test_alu_verifier);
+    RUN_TEST(test_parse_listing);
+    RUN_TEST(test_assembler_round_trips_disassembly);
+    RUN_TEST(test_assembler_labels_and_constants);
+    RUN_TEST(test_assembler_errors);
+    RUN_TEST(test_progress_snapshot);
     return UNITY_END();
 }